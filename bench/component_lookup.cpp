@@ -0,0 +1,101 @@
+// A microbenchmark for `Ent::Entity::get<T>()`.
+// Compares the component ID lookup with the old approach (a linear search over `typeid`s of all components),
+//   for entities with 1, 8 and 32 components.
+
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <tuple>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include "entities/base.h"
+#include "meta/misc.h"
+#include "program/entry_point.h"
+
+#include "support/report.h"
+
+namespace
+{
+    template <int N>
+    struct Comp : Ent::Component
+    {
+        int value = N;
+    };
+
+    // Reimplements the old lookup, for comparison.
+    class LegacyEntity
+    {
+        virtual const void *GetComponentPtr(std::type_index index) const noexcept = 0;
+
+      public:
+        virtual ~LegacyEntity() = default;
+
+        template <typename T>
+        [[nodiscard]] T &get()
+        {
+            return *const_cast<T *>(static_cast<const T *>(GetComponentPtr(typeid(T))));
+        }
+    };
+
+    template <typename ...C>
+    class SpecificLegacyEntity : public LegacyEntity
+    {
+        std::tuple<C...> components;
+
+        const void *GetComponentPtr(std::type_index type_index) const noexcept override
+        {
+            const void *ret = nullptr;
+            Meta::cexpr_any<sizeof...(C)>([&](auto i)
+            {
+                using T = std::tuple_element_t<i.value, std::tuple<C...>>;
+                if (typeid(T) != type_index)
+                    return false;
+                ret = &std::get<i.value>(components);
+                return true;
+            });
+            return ret;
+        }
+    };
+
+    // Measures `get<>()` of the last component, for entities with `N` components.
+    template <int N>
+    void Run()
+    {
+        constexpr std::size_t entity_count = 0x1000, iterations = 0x1000000;
+
+        [&]<int ...I>(std::integer_sequence<int, I...>)
+        {
+            using last_t = Comp<N-1>;
+
+            std::vector<std::unique_ptr<Ent::Entity>> entities;
+            std::vector<std::unique_ptr<LegacyEntity>> legacy_entities;
+            for (std::size_t i = 0; i < entity_count; i++)
+            {
+                entities.push_back(std::make_unique<Ent::impl::SpecificEntity<Comp<I>...>>());
+                legacy_entities.push_back(std::make_unique<SpecificLegacyEntity<Comp<I>...>>());
+            }
+
+            double t_new = Bench::Measure(iterations, [&](std::size_t i)
+            {
+                Bench::DoNotOptimize(entities[i % entity_count]->get<last_t>().value);
+            });
+            double t_old = Bench::Measure(iterations, [&](std::size_t i)
+            {
+                Bench::DoNotOptimize(legacy_entities[i % entity_count]->get<last_t>().value);
+            });
+
+            std::cout << N << " component(s): component ID = " << t_new << " ns, typeid search = " << t_old << " ns\n";
+        }(std::make_integer_sequence<int, N>{});
+    }
+}
+
+int _main_(int, char **)
+{
+    Run<1>();
+    Run<8>();
+    Run<32>();
+    return 0;
+}
@@ -0,0 +1,240 @@
+// The entity-component benchmark suite.
+// Runs each benchmark for every combination of allocator and storage, and writes the results as JSON
+//   (to the file passed as the first argument, or to `bench_results.json`), so the results can be compared between versions.
+// Measures:
+// * Creation and destruction throughput, both with `Create()` and `CreateMany()`.
+// * Iteration over entities with 1, 8 and 32 components, with `ForEach()` and by walking the list manually.
+// * `get<T>()` latency, for entities with 1, 8 and 32 components.
+// * `MakeEntityTemplate()` cost, depending on the amount of lists.
+// * `EntityTemplateCache` and `StaticEntityTemplateCache` lookup cost.
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include "entities/base.h"
+#include "entities/chunked_storage.h"
+#include "entities/slab_allocator.h"
+#include "meta/lists.h"
+#include "program/entry_point.h"
+
+#include "support/report.h"
+
+namespace
+{
+    template <int N>
+    struct Comp : Ent::Component
+    {
+        int value = N;
+    };
+
+    constexpr int max_components = 32;
+
+    // Calls `func(Meta::type_list<Comp<0>, ..., Comp<N-1>>{})`.
+    template <int N, typename F>
+    decltype(auto) WithComponents(F &&func)
+    {
+        return [&]<int ...I>(std::integer_sequence<int, I...>) -> decltype(auto)
+        {
+            return func(Meta::type_list<Comp<I>...>{});
+        }(std::make_integer_sequence<int, N>{});
+    }
+
+    // Returns a controller configured with a single list that includes all entities.
+    template <typename Controller>
+    std::pair<Controller, Ent::ListHandle> MakeController()
+    {
+        Ent::ControllerConfig config;
+        Ent::ListHandle list = config.AddList(Ent::has_components<Comp<0>>);
+        Controller controller;
+        config.ConfigureController(controller);
+        return {std::move(controller), list};
+    }
+
+    template <typename Controller>
+    void CreateAndDestroy(const std::string &config)
+    {
+        constexpr std::size_t count = 100'000;
+
+        WithComponents<8>([&]<typename ...C>(Meta::type_list<C...>)
+        {
+            auto [controller, list] = MakeController<Controller>();
+            auto te = controller.template MakeEntityTemplate<C...>();
+
+            std::vector<Ent::Entity *> entities(count);
+            double t_create = Bench::Time([&]
+            {
+                for (std::size_t i = 0; i < count; i++)
+                    entities[i] = &controller.Create(te);
+            });
+            double t_destroy = Bench::Time([&]
+            {
+                for (Ent::Entity *entity : entities)
+                    controller.Destroy(*entity);
+            });
+
+            double t_create_many = Bench::Time([&]
+            {
+                Bench::DoNotOptimize(controller.CreateMany(te, count).size());
+            });
+            double t_destroy_listed = Bench::Time([&]
+            {
+                controller.DestroyListed(list);
+            });
+
+            Bench::Report("create/8", config, t_create / count, "ns/entity");
+            Bench::Report("destroy/8", config, t_destroy / count, "ns/entity");
+            Bench::Report("create_many/8", config, t_create_many / count, "ns/entity");
+            Bench::Report("destroy_listed/8", config, t_destroy_listed / count, "ns/entity");
+        });
+    }
+
+    template <typename Controller, int N>
+    void IterateAndGet(const std::string &config)
+    {
+        constexpr std::size_t count = 100'000, passes = 16, lookups = 0x400000;
+
+        WithComponents<N>([&]<typename ...C>(Meta::type_list<C...>)
+        {
+            using last_t = Comp<N-1>;
+
+            auto [controller, list] = MakeController<Controller>();
+            auto te = controller.template MakeEntityTemplate<C...>();
+            Ent::EntityBatch batch = controller.CreateMany(te, count);
+
+            double t_for_each = Bench::Time([&]
+            {
+                for (std::size_t i = 0; i < passes; i++)
+                {
+                    int sum = 0;
+                    controller.template ForEach<last_t>(list, [&](last_t &comp){sum += comp.value;});
+                    Bench::DoNotOptimize(sum);
+                }
+            });
+            double t_list = Bench::Time([&]
+            {
+                for (std::size_t i = 0; i < passes; i++)
+                {
+                    int sum = 0;
+                    for (Ent::Entity &entity : controller(list))
+                        sum += entity.get<last_t>().value;
+                    Bench::DoNotOptimize(sum);
+                }
+            });
+
+            // Access the entities in random order, to measure the latency rather than the throughput.
+            std::vector<Ent::Entity *> entities;
+            for (Ent::Entity &entity : batch)
+                entities.push_back(&entity);
+            std::shuffle(entities.begin(), entities.end(), std::mt19937(42));
+            double t_get = Bench::Time([&]
+            {
+                for (std::size_t i = 0; i < lookups; i++)
+                    Bench::DoNotOptimize(entities[i % count]->get<last_t>().value);
+            });
+
+            std::string suffix = "/" + std::to_string(N);
+            Bench::Report("iterate_for_each" + suffix, config, t_for_each / (count * passes), "ns/entity");
+            Bench::Report("iterate_list" + suffix, config, t_list / (count * passes), "ns/entity");
+            Bench::Report("get_random" + suffix, config, t_get / lookups, "ns/call");
+        });
+    }
+
+    template <typename Controller>
+    void MakeTemplate(const std::string &config)
+    {
+        constexpr std::size_t iterations = 0x1000;
+
+        std::array<std::type_index, max_components> types = WithComponents<max_components>([]<typename ...C>(Meta::type_list<C...>)
+        {
+            return std::array<std::type_index, max_components>{typeid(C)...};
+        });
+
+        for (std::size_t list_count : {1, 16, 64, 256})
+        {
+            Ent::ControllerConfig controller_config;
+            for (std::size_t i = 0; i < list_count; i++)
+            {
+                (void)controller_config.AddList([type = types[i % max_components]](Ent::component_predicate_t *pred)
+                {
+                    return pred(type);
+                });
+            }
+            Controller controller;
+            controller_config.ConfigureController(controller);
+
+            double t = Bench::Time([&]
+            {
+                for (std::size_t i = 0; i < iterations; i++)
+                {
+                    auto te = controller.template MakeEntityTemplate<Comp<0>, Comp<1>, Comp<2>, Comp<3>>();
+                    Bench::DoNotOptimize(te.GetListHandles().size());
+                }
+            });
+
+            Bench::Report("make_entity_template/lists=" + std::to_string(list_count), config, t / iterations, "ns/call");
+        }
+    }
+
+    template <typename Controller, typename Cache>
+    void TemplateCacheLookup(const std::string &name, const std::string &config)
+    {
+        constexpr std::size_t iterations = 0x100000;
+
+        auto [controller, list] = MakeController<Controller>();
+        Cache cache;
+
+        // Fill the cache with templates for `{Comp<0>, Comp<i>}`.
+        WithComponents<max_components>([&]<typename ...C>(Meta::type_list<C...>)
+        {
+            ((void)cache.template GetTemplate<Meta::type_list<Comp<0>, C>>([&]{return controller.template MakeEntityTemplate<Comp<0>, C>();}), ...);
+        });
+
+        double t = Bench::Time([&]
+        {
+            for (std::size_t i = 0; i < iterations; i++)
+            {
+                const Ent::UntypedEntityTemplate &te = cache.template GetTemplate<Meta::type_list<Comp<0>, Comp<max_components-1>>>([&]
+                {
+                    return controller.template MakeEntityTemplate<Comp<0>, Comp<max_components-1>>();
+                });
+                Bench::DoNotOptimize(&te);
+            }
+        });
+
+        Bench::Report(name, config, t / iterations, "ns/call");
+    }
+
+    template <typename Controller>
+    void RunAll(const std::string &config)
+    {
+        CreateAndDestroy<Controller>(config);
+        IterateAndGet<Controller, 1>(config);
+        IterateAndGet<Controller, 8>(config);
+        IterateAndGet<Controller, 32>(config);
+        MakeTemplate<Controller>(config);
+        TemplateCacheLookup<Controller, Ent::EntityTemplateCache>("template_cache_lookup", config);
+        TemplateCacheLookup<Controller, Ent::StaticEntityTemplateCache>("static_template_cache_lookup", config);
+    }
+}
+
+int _main_(int argc, char **argv)
+{
+    std::string output_file = argc > 1 ? argv[1] : "bench_results.json";
+
+    RunAll<Ent::Controller<Meta::type_list<>, Ent::DefaultAllocator, Ent::PerEntityStorage>>("DefaultAllocator/PerEntityStorage");
+    RunAll<Ent::Controller<Meta::type_list<>, Ent::SlabAllocator<>, Ent::PerEntityStorage>>("SlabAllocator/PerEntityStorage");
+    RunAll<Ent::Controller<Meta::type_list<>, Ent::DefaultAllocator, Ent::ChunkedStorage<>>>("DefaultAllocator/ChunkedStorage");
+    RunAll<Ent::Controller<Meta::type_list<>, Ent::SlabAllocator<>, Ent::ChunkedStorage<>>>("SlabAllocator/ChunkedStorage");
+
+    Bench::WriteJson(output_file);
+    std::cout << "Results written to `" << output_file << "`.\n";
+    return 0;
+}
@@ -0,0 +1,204 @@
+// A benchmark for the CPU side of `Render`, without a GPU.
+// Uses `Graphics::RecordingBackend` instead of OpenGL, so the GL calls are only counted.
+// Each frame submits 100k sprites, and the time is measured separately for:
+// * `submit` - the `fquad()` or `fsprites()` calls, including the queue flushes when it overflows.
+// * `finish` - the final `Render::Finish()`.
+// Runs for several kinds of sprites (plain colored, textured, textured and rotated), submitted one by one and in a batch,
+//   for both vertex formats, and for two queue sizes:
+//   the one used by the game, and the largest one supported by the queue.
+// Also measures sprites using several textures in a random order, submitted directly (switching the textures as needed)
+//   and through a `RenderList` (which sorts them to minimize the texture switches).
+// Also reports the amount of draw calls and the uploaded bytes per frame.
+// Writes the results as JSON (to the file passed as the first argument, or to `bench_results.json`), like the other benchmarks.
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gameutils/render.h"
+#include "gameutils/render_list.h"
+#include "graphics/recording_backend.h"
+#include "graphics/shader.h"
+#include "graphics/texture.h"
+#include "program/entry_point.h"
+#include "utils/mat.h"
+
+#include "support/report.h"
+
+namespace
+{
+    constexpr std::size_t sprite_count = 100'000;
+    constexpr int warmup_frames = 3;
+    constexpr int frames = 20;
+    constexpr int texture_count = 4;
+    constexpr int layer_count = 4;
+
+    struct Sprite
+    {
+        fvec2 pos;
+        fvec2 size;
+        fvec2 tex_pos;
+        fvec3 color;
+        float angle = 0;
+        int texture = 0; // For the cases with several textures.
+        int layer = 0; // For `RenderList`.
+    };
+
+    std::vector<Sprite> MakeSprites()
+    {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> pos(-512, 512), size(4, 32), tex(0, 1024), color(0, 1), angle(0, 6.28f);
+        std::uniform_int_distribution<int> texture(0, texture_count - 1), layer(0, layer_count - 1);
+
+        std::vector<Sprite> ret(sprite_count);
+        for (Sprite &sprite : ret)
+            sprite = {fvec2(pos(rng), pos(rng)), fvec2(size(rng), size(rng)), fvec2(tex(rng), tex(rng)), fvec3(color(rng), color(rng), color(rng)), angle(rng), texture(rng), layer(rng)};
+        return ret;
+    }
+
+    std::vector<Render::Sprite> ToBatch(const std::vector<Sprite> &sprites)
+    {
+        std::vector<Render::Sprite> ret;
+        ret.reserve(sprites.size());
+        for (const Sprite &sprite : sprites)
+        {
+            Render::Sprite &out = ret.emplace_back();
+            out.pos = sprite.pos;
+            out.size = sprite.size;
+            out.tex_pos = sprite.tex_pos;
+            out.color = sprite.color;
+            out.angle = sprite.angle;
+        }
+        return ret;
+    }
+
+    using Textures = std::vector<Graphics::Texture>;
+
+    // Measures submitting a frame with `submit(Render &, const Textures &)`.
+    template <typename F>
+    void RunCase(const std::string &name, Render::VertexFormat format, int queue_size, F &&submit)
+    {
+        Graphics::RecordingBackend backend(false);
+
+        Textures textures;
+        for (int i = 0; i < texture_count; i++)
+            textures.push_back(Graphics::Texture(nullptr).SetData(ivec2(1024)));
+
+        Render r(queue_size, Graphics::ShaderConfig::Core(), format);
+        r.SetTextureSize(ivec2(1024));
+        r.BindShader();
+
+        double t_submit = 0, t_finish = 0;
+
+        for (int frame = 0; frame < warmup_frames + frames; frame++)
+        {
+            bool measure = frame >= warmup_frames;
+            if (frame == warmup_frames)
+                backend.Reset();
+
+            double t = Bench::Time([&]
+            {
+                submit(r, textures);
+            });
+            if (measure)
+                t_submit += t;
+
+            t = Bench::Time([&]
+            {
+                r.Finish();
+            });
+            if (measure)
+                t_finish += t;
+        }
+        const Graphics::RecordingBackend::Stats &stats = backend.GetStats();
+
+        std::string config = name + (format == Render::VertexFormat::packed ? "/packed" : "/full") + "/queue=" + std::to_string(queue_size);
+        Bench::Report("submit", config, t_submit / frames / 1e6, "ms/frame");
+        Bench::Report("finish", config, t_finish / frames / 1e6, "ms/frame");
+        Bench::Report("total_per_sprite", config, (t_submit + t_finish) / frames / sprite_count, "ns/sprite");
+        Bench::Report("draw_calls", config, double(stats.draw_calls) / frames, "calls/frame");
+        Bench::Report("bytes_uploaded", config, double(stats.bytes_uploaded) / frames, "bytes/frame");
+        Bench::Report("gl_calls", config, double(stats.calls) / frames, "calls/frame");
+    }
+
+    void RunAll(int queue_size, const std::vector<Sprite> &sprites)
+    {
+        std::vector<Render::Sprite> batch = ToBatch(sprites);
+        RenderList list;
+
+        for (Render::VertexFormat format : {Render::VertexFormat::full, Render::VertexFormat::packed})
+        {
+            RunCase("colored", format, queue_size, [&](Render &r, const Textures &)
+            {
+                for (const Sprite &sprite : sprites)
+                    r.fquad(sprite.pos, sprite.size).color(sprite.color);
+            });
+            RunCase("textured", format, queue_size, [&](Render &r, const Textures &)
+            {
+                for (const Sprite &sprite : sprites)
+                    r.fquad(sprite.pos, sprite.size).tex(sprite.tex_pos);
+            });
+            RunCase("textured_rotated", format, queue_size, [&](Render &r, const Textures &)
+            {
+                for (const Sprite &sprite : sprites)
+                    r.fquad(sprite.pos, sprite.size).tex(sprite.tex_pos).center().rotate(sprite.angle);
+            });
+            RunCase("batch_colored", format, queue_size, [&](Render &r, const Textures &)
+            {
+                r.fsprites(batch);
+            });
+            RunCase("batch_textured", format, queue_size, [&](Render &r, const Textures &)
+            {
+                r.fsprites(batch, Render::SpriteFlags::textured);
+            });
+            RunCase("batch_textured_rotated", format, queue_size, [&](Render &r, const Textures &)
+            {
+                r.fsprites(batch, Render::SpriteFlags::textured | Render::SpriteFlags::rotated);
+            });
+            RunCase("multitexture", format, queue_size, [&](Render &r, const Textures &textures)
+            {
+                int texture = -1;
+                for (const Sprite &sprite : sprites)
+                {
+                    if (sprite.texture != texture)
+                    {
+                        texture = sprite.texture;
+                        r.SetTexture(textures[texture]);
+                    }
+                    r.fquad(sprite.pos, sprite.size).tex(sprite.tex_pos);
+                }
+            });
+            RunCase("multitexture_list", format, queue_size, [&](Render &r, const Textures &textures)
+            {
+                list.SetRender(0, r);
+                for (int i = 0; i < texture_count; i++)
+                    list.SetTexture(i, textures[i]);
+
+                for (std::size_t i = 0; i < sprites.size(); i++)
+                {
+                    RenderList::Key key;
+                    key.layer = sprites[i].layer;
+                    key.texture = sprites[i].texture;
+                    list.Add(key, batch[i], Render::SpriteFlags::textured);
+                }
+                list.Flush();
+            });
+        }
+    }
+}
+
+int _main_(int argc, char **argv)
+{
+    std::string output_file = argc > 1 ? argv[1] : "bench_results.json";
+
+    std::vector<Sprite> sprites = MakeSprites();
+    RunAll(0x2000, sprites); // The queue size used by the game.
+    RunAll(0x8000, sprites); // The largest size, `Graphics::QuadRenderQueue::max_size` quads (the size here is measured in triangles).
+
+    Bench::WriteJson(output_file);
+    std::cout << "Results written to `" << output_file << "`.\n";
+    return 0;
+}
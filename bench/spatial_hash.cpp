@@ -0,0 +1,90 @@
+// A benchmark for `SpatialHash`.
+// For 10k, 100k and 1M uniformly distributed points (with the same density), measures:
+//   the batched rebuild (`Clear()` + `Insert()` + `Rebuild()`), radius queries, AABB queries and k-nearest lookups.
+// Radius queries are also compared with a brute-force scan over all points.
+
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "gameutils/spatial_hash.h"
+#include "program/entry_point.h"
+
+#include "support/report.h"
+
+namespace
+{
+    void Run(std::size_t point_count)
+    {
+        constexpr float cell_size = 32, query_radius = 32, density = 1 / 64.f; // Points per square unit.
+        constexpr std::size_t query_count = 0x10000, brute_force_query_count = 0x100, k = 8;
+
+        float world_size = std::sqrt(point_count / density);
+
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> coord(0, world_size);
+
+        std::vector<fvec2> points(point_count);
+        for (fvec2 &point : points)
+            point = fvec2(coord(rng), coord(rng));
+
+        std::vector<fvec2> queries(query_count);
+        for (fvec2 &query : queries)
+            query = fvec2(coord(rng), coord(rng));
+
+        SpatialHash<std::size_t> index(cell_size);
+
+        double t_rebuild = Bench::Measure(8, [&](std::size_t)
+        {
+            index.Clear();
+            for (std::size_t i = 0; i < point_count; i++)
+                index.Insert(points[i], i);
+            index.Rebuild();
+        });
+
+        double t_radius = Bench::Measure(query_count, [&](std::size_t i)
+        {
+            std::size_t found = 0;
+            index.ForEachInRadius(queries[i], query_radius, [&](const auto &){found++;});
+            Bench::DoNotOptimize(found);
+        });
+
+        double t_rect = Bench::Measure(query_count, [&](std::size_t i)
+        {
+            std::size_t found = 0;
+            index.ForEachInRect(queries[i] - query_radius, queries[i] + query_radius, [&](const auto &){found++;});
+            Bench::DoNotOptimize(found);
+        });
+
+        std::vector<SpatialHash<std::size_t>::Entry> nearest;
+        double t_nearest = Bench::Measure(query_count, [&](std::size_t i)
+        {
+            index.FindNearest(queries[i], k, nearest);
+            Bench::DoNotOptimize(nearest.data());
+        });
+
+        double t_brute_force = Bench::Measure(brute_force_query_count, [&](std::size_t i)
+        {
+            std::size_t found = 0;
+            for (fvec2 point : points)
+                found += (point - queries[i]).len_sqr() <= query_radius * query_radius;
+            Bench::DoNotOptimize(found);
+        });
+
+        std::cout << point_count << " points:\n"
+            << "  rebuild = " << t_rebuild / 1e6 << " ms\n"
+            << "  radius query = " << t_radius << " ns (brute force = " << t_brute_force << " ns)\n"
+            << "  AABB query = " << t_rect << " ns\n"
+            << "  " << k << " nearest = " << t_nearest << " ns\n";
+    }
+}
+
+int _main_(int, char **)
+{
+    Run(10'000);
+    Run(100'000);
+    Run(1'000'000);
+    return 0;
+}
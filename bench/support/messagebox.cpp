@@ -0,0 +1,30 @@
+// A replacement for `interface/messagebox.cpp`, for the benchmarks. Prints the messages to `stderr` instead of showing a window,
+//   so the benchmarks don't depend on SDL.
+
+#include "interface/messagebox.h"
+
+#include <iostream>
+
+namespace Interface
+{
+    void MessageBox(const std::string &title, const std::string &message)
+    {
+        MessageBox(MessageBoxType::info, title, message);
+    }
+
+    void MessageBox(MessageBoxType, const std::string &title, const std::string &message)
+    {
+        std::cerr << title << ": " << message << '\n';
+    }
+
+    int MessageBox(const std::string &title, const std::string &message, const std::vector<std::string> &buttons)
+    {
+        return MessageBox(MessageBoxType::info, title, message, buttons);
+    }
+
+    int MessageBox(MessageBoxType type, const std::string &title, const std::string &message, const std::vector<std::string> &)
+    {
+        MessageBox(type, title, message);
+        return -1;
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+// The helpers shared by the benchmarks: timing, and collecting the results to write them as JSON.
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "program/errors.h"
+
+namespace Bench
+{
+    // Prevents the compiler from optimizing away the computation of `value`.
+    template <typename T>
+    void DoNotOptimize(const T &value)
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    // Runs `func` once, returns the elapsed time in nanoseconds.
+    template <typename F>
+    double Time(F &&func)
+    {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count();
+    }
+
+    // Runs `func(i)` `count` times, returns the time per call in nanoseconds.
+    template <typename F>
+    double Measure(std::size_t count, F &&func)
+    {
+        return Time([&]
+        {
+            for (std::size_t i = 0; i < count; i++)
+                func(i);
+        }) / count;
+    }
+
+    struct Result
+    {
+        std::string name;
+        std::string config;
+        double value = 0;
+        std::string unit;
+    };
+
+    // All results reported so far.
+    [[nodiscard]] inline std::vector<Result> &Results()
+    {
+        static std::vector<Result> ret;
+        return ret;
+    }
+
+    // Prints a result and remembers it for `WriteJson()`.
+    inline void Report(std::string name, std::string config, double value, std::string unit)
+    {
+        std::cout << config << "  " << name << " = " << value << ' ' << unit << '\n';
+        Results().push_back({std::move(name), std::move(config), value, std::move(unit)});
+    }
+
+    // Writes all reported results to a file.
+    inline void WriteJson(const std::string &file_name)
+    {
+        std::ofstream file(file_name);
+        if (!file)
+            Program::Error("Unable to open `", file_name, "` for writing.");
+
+        const std::vector<Result> &results = Results();
+        file << "{\n  \"benchmarks\": [\n";
+        for (std::size_t i = 0; i < results.size(); i++)
+        {
+            const Result &result = results[i];
+            file << "    {\"name\": \"" << result.name << "\", \"config\": \"" << result.config << "\", \"value\": " << result.value << ", \"unit\": \"" << result.unit << "\"}";
+            file << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        file << "  ]\n}\n";
+
+        if (!file)
+            Program::Error("Unable to write to `", file_name, "`.");
+    }
+}
@@ -61,3 +61,19 @@ override generated_headers := math:src/utils/mat.h macros:src/macros/generated.h
 override generate_file = $(call host_native_path,$2) : $(generators_dir)/make_$1.cpp ; \
 	@+$(MAKE) -f gen/Makefile _gen_dir=$(generators_dir) _gen_source_file=make_$1 _gen_target_file=$2 --no-print-directory
 $(foreach f,$(generated_headers),$(eval $(call generate_file,$(word 1,$(subst :, ,$f)),$(word 2,$(subst :, ,$f)))))
+
+# Benchmarks
+# `make bench` builds `bench/$(BENCH).cpp` into a separate executable and runs it, with `$(BENCH_OUTPUT)` as the only argument.
+# The default benchmark (`entities`) writes its results to that file as JSON.
+# The benchmarks don't use SDL or OpenGL, `bench/support/messagebox.cpp` replaces the only SDL-dependent part of the error handling.
+# They are always built with optimizations, regardless of the build mode.
+# The benchmarks that need more than headers list the extra source files in `bench_sources_<name>`.
+# They don't link `src/utils/allocation_tracking.cpp`, so `IMP_ALLOCATION_TRACKING` is set to 0 to report the tracking as unavailable.
+BENCH := entities
+BENCH_OUTPUT := bench_results.json
+override bench_exe = bin/bench_$(BENCH)$(extension_exe)
+override bench_sources_render := src/gameutils/render.cpp src/gameutils/render_list.cpp src/graphics/recording_backend.cpp lib/cglfl.cpp
+.PHONY: bench
+bench: __no_mode_needed $(lib_pack_info_file)
+	$(CXX_COMPILER) $(CXXFLAGS) -DNDEBUG -O3 -DFMT_HEADER_ONLY -DIMP_ALLOCATION_TRACKING=0 -UENTRY_POINT_OVERRIDE bench/$(BENCH).cpp bench/support/messagebox.cpp $(bench_sources_$(BENCH)) -o $(bench_exe)
+	$(bench_exe) $(BENCH_OUTPUT)
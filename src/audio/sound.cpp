@@ -6,12 +6,15 @@
 
 #include "macros/finally.h"
 #include "strings/format.h"
+#include "utils/profiler.h"
 #include "utils/robust_math.h"
 
 namespace Audio
 {
     Sound::Sound(Format format, std::optional<Channels> expected_channel_count, Stream::Input input, BitResolution preferred_resolution)
     {
+        PROFILE_SCOPE("Sound::Sound (load)");
+
         auto CheckChannelCount = [&]
         {
             if (expected_channel_count && *expected_channel_count != channel_count)
@@ -1,10 +1,16 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <concepts>
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <new>
+#include <optional>
+#include <string>
 #include <tuple>
 #include <type_traits>
 #include <typeindex>
@@ -26,6 +32,13 @@ namespace Ent
     // A common base class for components.
     struct Component {};
 
+    namespace impl
+    {
+        // Saves and loads the entities of controllers, see `entities/snapshot.h`.
+        // It's a friend of `Entity`, `EntityHandle` and `Controller`, because snapshots need access to their internals.
+        struct SnapshotAccess;
+    }
+
     // The alignment that components get. Overaligned components trigger a static assertion.
     inline constexpr std::size_t component_alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
 
@@ -39,41 +52,159 @@ namespace Ent
         std::derived_from<T, Component> && !std::is_same_v<T, Component> &&
         !std::is_const_v<T> && !std::is_volatile_v<T> && alignof(T) <= component_alignment;
 
+    // A concept for the components requested from `Controller::ForEach()`, `Query()` and so on.
+    // Same as `ValidComponent`, but can be const. Such components are accessed read-only, and aren't marked as changed (see `TrackChanges`).
+    template <typename T>
+    concept ValidRequestedComponent = ValidComponent<std::remove_const_t<T>>;
+
 
     namespace impl
     {
-        // Returns a pointer to a tuple element with specified `std::type_index`, null if no such element.
-        // The tuple is supposed to contain unique types only.
-        template <typename ...P>
-        const void *GetTupleElemByTypeIndex(const std::tuple<P...> &tuple, std::type_index type_index) noexcept
+        // Makes sure that `vec` can hold `extra` more elements without reallocating.
+        // Unlike `vec.reserve(vec.size() + extra)`, grows the capacity geometrically, so calling this before each insertion is cheap.
+        template <typename T>
+        void ReserveExtra(std::vector<T> &vec, std::size_t extra)
         {
-            using tuple_t = std::tuple<P...>;
-            const void *ret = nullptr;
-            Meta::cexpr_any<sizeof...(P)>([&](auto index)
+            std::size_t required = vec.size() + extra;
+            if (required > vec.capacity())
+                vec.reserve(std::max(required, vec.capacity() * 2));
+        }
+
+        // Returns the next unused entity template ID, see `StaticEntityTemplateCache`.
+        // Thread-safe, since the templates can be first used from several threads at once.
+        [[nodiscard]] inline std::size_t NextTemplateId()
+        {
+            static std::atomic<std::size_t> counter = 0;
+            return counter.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Returns the next unused component ID.
+        // Thread-safe, since the components can be first used from several threads at once (e.g. in `ParallelForEach()`).
+        [[nodiscard]] inline std::size_t NextComponentId()
+        {
+            static std::atomic<std::size_t> counter = 0;
+            return counter.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Maps component IDs (see `ComponentId()`) to some values, for a specific entity type.
+        // The values are usually component offsets. The table is sized to the largest ID of the components it contains,
+        //   IDs past the end map to -1, which means that the entity doesn't have the component.
+        class ComponentTable
+        {
+            std::vector<std::size_t> values;
+
+          public:
+            ComponentTable() {}
+
+            void Set(std::size_t component_id, std::size_t value)
             {
-                constexpr auto i = index.value;
-                using member_t = std::tuple_element_t<i, tuple_t>;
-                if (typeid(member_t) != type_index)
-                    return false;
-                ret = &std::get<i>(tuple);
-                return true;
-            });
-            return ret;
+                if (component_id >= values.size())
+                    values.resize(component_id + 1, -1);
+                values[component_id] = value;
+            }
+
+            // Returns the value for the specified component ID, or -1 if none.
+            [[nodiscard]] std::size_t Get(std::size_t component_id) const noexcept
+            {
+                return component_id < values.size() ? values[component_id] : -1;
+            }
+        };
+    }
+
+    // Returns a dense integral ID of a component type.
+    // The IDs are assigned on the first use, starting from 0. They are not stable between program runs.
+    template <ValidComponent T>
+    [[nodiscard]] std::size_t ComponentId()
+    {
+        static const std::size_t ret = impl::NextComponentId();
+        return ret;
+    }
+
+    namespace impl
+    {
+        // The global change tick, see `CurrentChangeTick()`.
+        [[nodiscard]] inline std::uint64_t &ChangeTickCounter()
+        {
+            static std::uint64_t counter = 1;
+            return counter;
         }
     }
 
+    // Returns the current change tick. Components inheriting from `TrackChanges` are stamped with it when modified.
+    [[nodiscard]] inline std::uint64_t CurrentChangeTick()
+    {
+        return impl::ChangeTickCounter();
+    }
+    // Ends the current change tick and returns its number. Subsequent modifications get a larger stamp.
+    // To process each change exactly once, remember the result of this function after processing the changes,
+    //   and pass it to `ForEachChanged()` (or `ChangedSince()`) next time. Start with 0 to see all existing components.
+    // Not thread-safe, and shouldn't be called while the components are being modified in parallel.
+    inline std::uint64_t AdvanceChangeTick()
+    {
+        return impl::ChangeTickCounter()++;
+    }
+
+    // Inherit a component from this class to opt into change tracking.
+    // The component is stamped with `CurrentChangeTick()` when it's constructed, assigned,
+    //   or accessed through non-const `Entity::get()` or `Entity::set()`,
+    //   or passed to the callback of `Controller::ForEach()` and `ParallelForEach()`, or returned by `Controller::Query()`.
+    // All of those count as modifications, even if the component is only read.
+    // To avoid that, request the component as const from those functions, e.g. `ForEach<const Pos>(...)`.
+    // Costs 8 bytes per component.
+    class TrackChanges
+    {
+        std::uint64_t change_tick = CurrentChangeTick();
+
+      public:
+        TrackChanges() {}
+
+        // Copies and assignments count as modifications, so the stamp is never copied.
+        TrackChanges(const TrackChanges &) {}
+        TrackChanges &operator=(const TrackChanges &)
+        {
+            MarkChanged();
+            return *this;
+        }
+
+        // Stamps the component with the current change tick.
+        void MarkChanged()
+        {
+            change_tick = CurrentChangeTick();
+        }
+
+        // Returns the tick of the last modification.
+        [[nodiscard]] std::uint64_t LastChangeTick() const
+        {
+            return change_tick;
+        }
+
+        // Checks if the component was modified after the tick `tick` ended. See `AdvanceChangeTick()`.
+        [[nodiscard]] bool ChangedSince(std::uint64_t tick) const
+        {
+            return change_tick > tick;
+        }
+    };
+
     // A common abstract base for entities.
     class Entity
     {
-        /* Explanation on `__attribute__((const))`:
-         * It's is a hint to the optimizer. It means that the return value depends only on the parameters,
+        /* Explanation on `__attribute__((const))` and `__attribute__((pure))`:
+         * They are hints to the optimizer. `const` means that the return value depends only on the parameters,
          * and there are no side effects. Since the functions below merely return `this + offset` or booleans, it should be allowed.
-         * GCC doesn't seem to be clever enough to utilize this attribute though, but Clang appears to use it.
+         * `pure` is weaker, it allows the function to read memory. The base function uses it, because some storages
+         *   (see `ChunkedStorage`) can move the components of an entity elsewhere while keeping the entity itself in place.
+         * GCC doesn't seem to be clever enough to utilize those attributes though, but Clang appears to use them.
          */
 
-        // Returns a pointer to a component of this entity with the specified type index, or null if no such component.
-        __attribute__((const))
-        virtual const void *GetComponentPtr(std::type_index index) const noexcept = 0;
+        // Returns a pointer to a component of this entity with the specified ID (see `ComponentId()`), or null if no such component.
+        // Implementations are expected to use a per-type `impl::ComponentTable`, so this should be a single indexed load and an addition.
+        __attribute__((pure))
+        virtual const void *GetComponentPtr(std::size_t component_id) const noexcept = 0;
+
+        // The index of the slot in the handle table of the controller that owns this entity. See `EntityHandle`.
+        std::uint32_t handle_slot = -1;
+
+        friend impl::SnapshotAccess;
 
       public:
         Entity() {}
@@ -92,20 +223,24 @@ namespace Ent
         template <ValidComponent T>
         [[nodiscard]] bool has() const
         {
-            return bool(GetComponentPtr(typeid(T)));
+            return bool(GetComponentPtr(ComponentId<T>()));
         }
 
         // Get component by type. Throws if no such component.
+        // If the component inherits from `TrackChanges`, it's marked as changed.
         template <ValidComponent T>
         [[nodiscard]] T &get()
         {
-            return const_cast<T &>(std::as_const(*this).get<T>());
+            T &ret = const_cast<T &>(std::as_const(*this).get<T>());
+            if constexpr (std::derived_from<T, TrackChanges>)
+                ret.MarkChanged();
+            return ret;
         }
         // Get component by type. Throws if no such component.
         template <ValidComponent T>
         [[nodiscard]] const T &get() const
         {
-            const void *ret = GetComponentPtr(typeid(T));
+            const void *ret = GetComponentPtr(ComponentId<T>());
             if (!ret)
                 Program::Error(FMT("No component `{}` in this entity.", Meta::TypeName<T>()));
             return *static_cast<const T *>(ret);
@@ -127,9 +262,40 @@ namespace Ent
             get<T>() = std::move(value);
             return *this;
         }
+
+        // For internal use. Returns the index of the slot in the handle table of the controller that owns this entity.
+        [[nodiscard]] std::uint32_t GetHandleSlot() const
+        {
+            return handle_slot;
+        }
+        // For internal use. Sets the index returned by `GetHandleSlot()`.
+        void SetHandleSlot(std::uint32_t slot)
+        {
+            handle_slot = slot;
+        }
     };
 
 
+    namespace impl
+    {
+        // Same as `entity.get<T>()`, but doesn't mark the component as changed (see `TrackChanges`).
+        template <ValidComponent T>
+        [[nodiscard]] T &GetComponentUntracked(Entity &entity)
+        {
+            return const_cast<T &>(std::as_const(entity).get<T>());
+        }
+
+        // If the component inherits from `TrackChanges` and `T` is not const, marks it as changed. Returns the same reference.
+        template <ValidRequestedComponent T>
+        T &MarkChangedIfTracked(T &component)
+        {
+            if constexpr (!std::is_const_v<T> && std::derived_from<T, TrackChanges>)
+                component.MarkChanged();
+            return component;
+        }
+    }
+
+
     namespace impl
     {
         // Base classes for `Requires` and `Implies`.
@@ -193,6 +359,41 @@ namespace Ent
             return ret;
         }();
 
+        // Returns an initializer for component `T`, given a list of component initializers `params...`.
+        // If there's a parameter with the same type as `T` (ignoring cv-qualifiers and value category),
+        //   it's forwarded. Otherwise `DefaultComponentInitializer{}` is returned, which should default-construct the component.
+        template <typename T, typename ...P>
+        decltype(auto) GetComponentInitializer(P &&... params)
+        {
+            constexpr std::size_t index = find_type_index_ignoring_cvref<T, P...>;
+
+            // Make sure we didn't get more than one initializer.
+            // Note that the condition is separated into a variable, to prevent it from cluttering the error message.
+            constexpr bool x = index != std::size_t(-2);
+            static_assert(("More than one initializer was provided for component", Meta::tag<T>{}, x));
+
+            if constexpr (index == std::size_t(-1))
+                return DefaultComponentInitializer{};
+            else
+                return std::get<index>(std::forward_as_tuple(std::forward<P>(params)...));
+        }
+
+        // Makes sure that each of `P...` (ignoring cvref) is one of the components in the list `L`.
+        // Always returns true, but triggers a static assertion on failure.
+        template <typename L, typename ...P>
+        constexpr bool CheckNoExtraComponentInitializers()
+        {
+            ([]<typename T>(Meta::tag<T>)
+            {
+                // Here `T` is one of `P...`.
+                // Check if the entity actually has a component `std::remove_cvref<T>`.
+                // Note that the condition is separated into a variable, to prevent it from cluttering the error message.
+                constexpr bool x = Meta::list_contains_type<L, std::remove_cvref_t<T>>;
+                static_assert(("This entity doesn't contain component", Meta::tag<T>{}, "but an initializer for it was provided.", x));
+            }(Meta::tag<P>{}), ...);
+            return true;
+        }
+
         // Inherits from `Entity` and stores components `C...`.
         // Don't use this class directly, because it doesn't remove duplicates from `C...` and doesn't enforce component dependencies.
         template <ValidComponent ...C>
@@ -201,9 +402,25 @@ namespace Ent
             std::tuple<C...> components;
 
             __attribute__((const)) // See the base class for the explanation of this attribute.
-            const void *GetComponentPtr(std::type_index index) const noexcept override final
+            const void *GetComponentPtr(std::size_t component_id) const noexcept override final
             {
-                return GetTupleElemByTypeIndex(components, index);
+                // Maps component IDs to their offsets relative to `this`.
+                // The offsets are the same for all instances, so we compute them once, using the first instance we get.
+                static const ComponentTable table = [&]
+                {
+                    ComponentTable ret;
+                    Meta::cexpr_for<sizeof...(C)>([&](auto i)
+                    {
+                        using T = std::tuple_element_t<i.value, std::tuple<C...>>;
+                        ret.Set(ComponentId<T>(), reinterpret_cast<const char *>(&std::get<i.value>(components)) - reinterpret_cast<const char *>(this));
+                    });
+                    return ret;
+                }();
+
+                std::size_t offset = table.Get(component_id);
+                if (offset == std::size_t(-1))
+                    return nullptr;
+                return reinterpret_cast<const char *>(this) + offset;
             }
 
           public:
@@ -217,39 +434,13 @@ namespace Ent
             requires(std::default_initializable<C> && ...)
             {}
 
-            // Initializes each component separately.
-            // If there's a parameter with the same type as the component (ignoring cv-qualifiers and value category),
-            //   the corresponding component is initialized with it. Otherwise it's initialized
-            //   with `DefaultComponentInitializer{}`, which should default-construct it.
+            // Initializes each component separately, see `GetComponentInitializer()` for details.
             template <typename ...P>
             requires(ValidComponent<std::remove_cvref_t<P>> && ...)
-            SpecificEntity(P &&... params) : components(
-                // Make a list of initializers for the tuple.
-                []<typename T>(Meta::tag<T>, P &&... params) -> decltype(auto)
-                {
-                    // Here `T` is one of `C...`.
-                    constexpr std::size_t index = find_type_index_ignoring_cvref<C, P...>;
-
-                    // Make sure we didn't get more than one initializer.
-                    // Note that the condition is separated into a variable, to prevent it from cluttering the error message.
-                    constexpr bool x = index != std::size_t(-2);
-                    static_assert(("More than one initializer was provided for component", Meta::tag<C>{}, x));
-
-                    if constexpr (index == std::size_t(-1))
-                        return DefaultComponentInitializer{};
-                    else
-                        return std::get<index>(std::forward_as_tuple(std::forward<P>(params)...));
-                }(Meta::tag<C>{}, std::forward<P>(params)...)...)
+            SpecificEntity(P &&... params) : components(GetComponentInitializer<C>(std::forward<P>(params)...)...)
             {
                 // Make sure we don't have any extra unused initializers.
-                ([]<typename T>(Meta::tag<T>)
-                {
-                    // Here `T` is one of `P...`.
-                    // Check if the entity actually has a component `std::remove_cvref<T>`.
-                    // Note that the condition is separated into a variable, to prevent it from cluttering the error message.
-                    constexpr bool x = Meta::list_contains_type<Meta::type_list<C...>, std::remove_cvref_t<T>>;
-                    static_assert(("This entity doesn't contain component", Meta::tag<T>{}, "but an initializer for it was provided.", x));
-                }(Meta::tag<P>{}), ...);
+                static_assert(CheckNoExtraComponentInitializers<Meta::type_list<C...>, P...>());
             }
         };
 
@@ -320,6 +511,19 @@ namespace Ent
                                               Meta::type_list<T>>>; // 1. This type.
         };
 
+        // Removes `T` from the list `L`.
+        template <typename T, typename L>
+        struct RemoveComponentFromList
+        {
+            using type = Meta::type_list<>;
+        };
+        template <typename T, typename F, typename ...P>
+        struct RemoveComponentFromList<T, Meta::type_list<F, P...>>
+        {
+            using type = Meta::list_cat<std::conditional_t<std::is_same_v<T, F>, Meta::type_list<>, Meta::type_list<F>>,
+                                        typename RemoveComponentFromList<T, Meta::type_list<P...>>::type>;
+        };
+
 
         // Check if component list `L` satisfies requirements of component `C`.
         // Always returns true, but triggers a static assertion on failure.
@@ -553,6 +757,11 @@ namespace Ent
         {
             return head;
         }
+        // For internal use. Returns the head node of the linked list that this instance owns.
+        [[nodiscard]] const impl::ListNode &GetHeadNode() const
+        {
+            return head;
+        }
 
         // Iterators.
         // In short, use `.begin()` and `.end()` (which return `iterator_t`) to iterate forward.
@@ -649,6 +858,51 @@ namespace Ent
         }
     };
 
+    // A weak reference to an entity, obtained from `Controller::GetHandle()`.
+    // Unlike `Entity &`, it can be safely kept after the entity is destroyed: `Controller::TryGet()` will then return null.
+    // Consists of a slot index in the controller's handle table, and a generation counter that is incremented each time the slot is reused.
+    class EntityHandle
+    {
+        std::uint32_t index = -1;
+        std::uint32_t generation = 0;
+
+        // Snapshots make the handles reflected, so the components storing them can be saved. See `entities/snapshot.h`.
+        friend impl::SnapshotAccess;
+
+      public:
+        // Makes a null (invalid) handle.
+        EntityHandle() {}
+
+        // Checks if the handle is null or not.
+        // Note that a non-null handle can still point to a destroyed entity.
+        [[nodiscard]] explicit operator bool() const
+        {
+            return index != std::uint32_t(-1);
+        }
+
+        [[nodiscard]] friend bool operator==(const EntityHandle &a, const EntityHandle &b)
+        {
+            return a.index == b.index && a.generation == b.generation;
+        }
+        [[nodiscard]] friend bool operator!=(const EntityHandle &a, const EntityHandle &b)
+        {
+            return !(a == b);
+        }
+
+        // Mostly for internal use. Constructs a new handle given a slot index and a generation.
+        [[nodiscard]] static EntityHandle Construct(std::uint32_t index, std::uint32_t generation)
+        {
+            EntityHandle ret;
+            ret.index = index;
+            ret.generation = generation;
+            return ret;
+        }
+
+        // For internal use.
+        [[nodiscard]] std::uint32_t GetIndex() const {return index;}
+        [[nodiscard]] std::uint32_t GetGeneration() const {return generation;}
+    };
+
 
     // For internal use, unless you're writing a custom entity template cache.
     // A non-template base for `EntityTemplate`.
@@ -691,7 +945,7 @@ namespace Ent
         !std::is_const_v<T> && !std::is_volatile_v<T>;
 
     // A default implementation of an entity template cache.
-    // Uses a hash map under the hood.
+    // Uses a hash map under the hood. See `StaticEntityTemplateCache` for a faster alternative.
     class EntityTemplateCache : public BasicEntityTemplateCache
     {
         std::unordered_map<std::type_index, UntypedEntityTemplate> map;
@@ -712,6 +966,42 @@ namespace Ent
         }
     };
 
+    // Returns a dense integral ID of a component list, used by `StaticEntityTemplateCache`.
+    // The IDs are assigned on the first use, starting from 0. They are not stable between program runs.
+    template <Meta::specialization_of<Meta::type_list> L>
+    [[nodiscard]] std::size_t TemplateId()
+    {
+        static const std::size_t ret = impl::NextTemplateId();
+        return ret;
+    }
+
+    // An entity template cache that doesn't hash anything.
+    // Each component list gets a global ID on the first use (see `TemplateId()`), which is used as an index into an array of templates.
+    // After a template is cached, a lookup is a bounds check and two loads, with no hashing, no RTTI and no list predicate calls.
+    // Like any cache, an instance must be used only with controllers that have the same configuration.
+    class StaticEntityTemplateCache : public BasicEntityTemplateCache
+    {
+        // The templates are allocated separately, to keep the references to them valid when the vector grows.
+        std::vector<std::unique_ptr<UntypedEntityTemplate>> templates;
+
+      public:
+        // If the template for `C...` is cached, a reference to it is returned.
+        // Otherwise it's constructed by calling `create_template()`, which should return an `UntypedEntityTemplate` by value.
+        template <Meta::specialization_of<Meta::type_list> L, typename F>
+        [[nodiscard]] const UntypedEntityTemplate &GetTemplate(F &&create_template)
+        {
+            std::size_t id = TemplateId<L>();
+            if (id < templates.size() && templates[id])
+                return *templates[id];
+
+            auto new_template = std::make_unique<UntypedEntityTemplate>(std::forward<F>(create_template)());
+            if (id >= templates.size())
+                templates.resize(id + 1);
+            templates[id] = std::move(new_template);
+            return *templates[id];
+        }
+    };
+
 
     // The default allocator.
     // Dealing with `std::allocator_traits`-based allocators seems to be way too compilcated,
@@ -741,6 +1031,389 @@ namespace Ent
     };
 
 
+    // A range of entities created by `Controller::CreateMany()`, in the creation order.
+    // Consists of one or more segments, each being a sequence of entities placed at regular intervals in memory.
+    // Normally there's just one segment, since the storages try to place the batch contiguously.
+    class EntityBatch
+    {
+        struct Segment
+        {
+            Entity *first = nullptr;
+            std::ptrdiff_t stride = 0;
+            std::size_t count = 0;
+        };
+
+        std::vector<Segment> segments;
+        std::size_t entity_count = 0;
+
+        struct State
+        {
+            const Segment *segment = nullptr;
+            std::size_t index = 0;
+
+            // Increment.
+            void operator()(std::true_type)
+            {
+                if (++index == segment->count)
+                {
+                    segment++;
+                    index = 0;
+                }
+            }
+
+            // Dereference.
+            Entity &operator()(std::false_type) const
+            {
+                return *std::launder(reinterpret_cast<Entity *>(reinterpret_cast<char *>(segment->first) + segment->stride * std::ptrdiff_t(index)));
+            }
+
+            bool operator==(const State &other) const
+            {
+                return segment == other.segment && index == other.index;
+            }
+        };
+
+      public:
+        EntityBatch() {}
+
+        // For internal use. Appends an entity to the batch, extending the last segment if possible.
+        // The entities must have the same type, otherwise the segments would mix different subobject offsets.
+        void AddEntity(Entity &entity)
+        {
+            char *address = reinterpret_cast<char *>(&entity);
+            if (!segments.empty())
+            {
+                Segment &last = segments.back();
+                std::ptrdiff_t offset = address - reinterpret_cast<char *>(last.first);
+                if (last.count == 1 && offset != 0)
+                    last.stride = offset;
+                if (offset == last.stride * std::ptrdiff_t(last.count))
+                {
+                    last.count++;
+                    entity_count++;
+                    return;
+                }
+            }
+            segments.push_back({&entity, 0, 1});
+            entity_count++;
+        }
+
+        [[nodiscard]] std::size_t size() const
+        {
+            return entity_count;
+        }
+        [[nodiscard]] bool empty() const
+        {
+            return entity_count == 0;
+        }
+
+        // The amount of contiguous segments. For debugging and testing.
+        [[nodiscard]] std::size_t SegmentCount() const
+        {
+            return segments.size();
+        }
+
+        using iterator_t = SimpleIterator::Forward<State>;
+
+        [[nodiscard]] iterator_t begin() const
+        {
+            return State{segments.data(), 0};
+        }
+        [[nodiscard]] iterator_t end() const
+        {
+            return State{segments.data() + segments.size(), 0};
+        }
+    };
+
+
+    // A common base class for entity storage policies.
+    // A storage policy decides where the entities (and their components) live in memory.
+    class BasicEntityStorage {};
+
+    // A concept for entity storage policies.
+    // Simply checks if it inherits from the base and is default-constructible and movable, because writing a proper concept seems to be too tricky.
+    // A storage must provide following functions (`A` is an allocator type):
+    // * `template <Meta::type_list L> Entity &Create(A &allocator, const UntypedEntityTemplate &entity_template, F &&ith_list_head, P &&... params)`
+    //     Creates a new entity with the components `L`, forwarding `params...` to the components.
+    //     `ith_list_head` is `ListNode &ith_list_head(int i) noexcept`, it returns the head node of the i-th list the entity should be appended to.
+    // * `template <Meta::type_list L> EntityBatch CreateMany(A &allocator, const UntypedEntityTemplate &entity_template, std::size_t count, F &&ith_list_head, G &&initializer)`
+    //     Creates `count` entities. `initializer(i)` returns a `std::tuple` of `params...` for the i-th entity.
+    //     If something throws, destroys the entities created so far.
+    // * `void Destroy(A &allocator, Entity &entity)` - Destroys an entity that was created by this storage.
+    // * `void ReleaseMemory(A &allocator)` - Is called when the storage has no entities left, to free any cached memory.
+    // * `template <Meta::type_list L> Entity &Migrate(A &allocator, Entity &entity, const UntypedEntityTemplate &entity_template, F &&ith_list_head, P &&... params)`
+    //     Gives an existing entity the components `L`, forwarding `params...` to them. The params can refer to the old components of the entity.
+    //     `ith_list_head` is the same as in `Create()`, but can return the list nodes of `entity` itself.
+    //     Returns the entity with the new components. It's either the same object, or a new one, then the old one is destroyed.
+    //     If something throws, the entity must be left unchanged (except for the components moved from by `params...`).
+    // * `ListNode &GetListNode<L>(Entity &entity, int i) const` - Returns the i-th list node of an entity created by `Create<L>()`.
+    // * `void ForEach<C...>(const List &list, std::size_t list_index, F &&func) const`
+    //     Calls `func(C &...)` for every entity in the list. Throws if some of the entities lack the components.
+    //     Shouldn't mark the components as changed, the controller does that (see `TrackChanges`).
+    // * `auto Query<C...>(const List &list, std::size_t list_index) const`
+    //     Returns a range of `std::tuple<C &...>`, one for each entity in the list that has all of `C...` (others are skipped).
+    //     Some of `C...` can be const (see `ValidRequestedComponent`).
+    //     Dereferencing the iterators must mark the non-const components as changed, using `impl::MarkChangedIfTracked<C>()`.
+    // * `void ParallelForEach<C...>(Pool &pool, const List &list, std::size_t list_index, std::size_t grain_size, F &&func) const`
+    //     Same, but splits the entities into batches of approximately `grain_size` and processes them using `pool.ParallelFor()`.
+    template <typename T>
+    concept ValidEntityStorage =
+        std::derived_from<T, BasicEntityStorage> && !std::is_same_v<T, BasicEntityStorage> &&
+        std::default_initializable<T> && std::movable<T> &&
+        !std::is_const_v<T> && !std::is_volatile_v<T>;
+
+    namespace impl
+    {
+        // A range returned by `PerEntityStorage::Query()`.
+        // Walks a list and skips the entities that lack some of `C...`.
+        // Since the components of `SpecificEntity` are at fixed offsets, the offsets are computed once for each entity type,
+        //   and are reused while the consecutive entities have the same type.
+        template <ValidRequestedComponent ...C>
+        class PerEntityQuery
+        {
+            const List &list;
+
+            struct State
+            {
+                const ListNode *node = nullptr;
+                const ListNode *end = nullptr;
+
+                // The last seen entity type, and the component offsets for it.
+                const std::type_info *type = nullptr;
+                bool type_matches = false;
+                std::array<std::ptrdiff_t, sizeof...(C)> offsets{};
+
+                // Advances to the first matching entity, starting from the current one.
+                void SkipNonMatching()
+                {
+                    for (; node != end; node = node->Next())
+                    {
+                        const Entity &entity = *node->Target();
+                        const std::type_info *this_type = &typeid(entity);
+                        if (this_type != type)
+                        {
+                            type = this_type;
+                            type_matches = (entity.has<std::remove_const_t<C>>() && ...);
+                            if (type_matches)
+                            {
+                                std::size_t i = 0;
+                                ((offsets[i++] = reinterpret_cast<const char *>(&entity.get<std::remove_const_t<C>>()) - reinterpret_cast<const char *>(&entity)), ...);
+                            }
+                        }
+
+                        if (type_matches)
+                            return;
+                    }
+                }
+
+                // Increment.
+                void operator()(std::true_type)
+                {
+                    node = node->Next();
+                    SkipNonMatching();
+                }
+
+                // Dereference.
+                std::tuple<C &...> operator()(std::false_type) const
+                {
+                    char *base = reinterpret_cast<char *>(node->Target());
+                    return [&]<std::size_t ...I>(std::index_sequence<I...>)
+                    {
+                        return std::tuple<C &...>(MarkChangedIfTracked<C>(*std::launder(reinterpret_cast<C *>(base + offsets[I])))...);
+                    }(std::make_index_sequence<sizeof...(C)>{});
+                }
+
+                bool operator==(const State &other) const
+                {
+                    return node == other.node;
+                }
+            };
+
+          public:
+            PerEntityQuery(const List &list) : list(list) {}
+
+            using iterator_t = SimpleIterator::Input<State>;
+
+            [[nodiscard]] iterator_t begin() const
+            {
+                State state;
+                state.node = list.GetHeadNode().Next();
+                state.end = &list.GetHeadNode();
+                state.SkipNonMatching();
+                return state;
+            }
+            [[nodiscard]] iterator_t end() const
+            {
+                State state;
+                state.node = &list.GetHeadNode();
+                return state;
+            }
+        };
+    }
+
+    // The default entity storage.
+    // Each entity gets a separate allocation, with the list nodes stored right after it.
+    class PerEntityStorage : public BasicEntityStorage
+    {
+        // A memory block allocated by `CreateMany()`.
+        struct Batch
+        {
+            char *begin = nullptr;
+            char *end = nullptr;
+            // The amount of live entities in the block.
+            std::size_t live = 0;
+        };
+        // Sorted by address.
+        std::vector<Batch> batches;
+
+        struct CompareBatchBegin
+        {
+            bool operator()(const char *pointer, const Batch &batch) const {return std::less<>{}(pointer, batch.begin);}
+        };
+
+        // Returns the batch containing `pointer`, or `batches.end()` if none.
+        [[nodiscard]] std::vector<Batch>::iterator FindBatch(const char *pointer)
+        {
+            auto it = std::upper_bound(batches.begin(), batches.end(), pointer, CompareBatchBegin{});
+            if (it == batches.begin())
+                return batches.end();
+            --it;
+            return std::less<>{}(pointer, it->end) ? it : batches.end();
+        }
+
+      public:
+        template <Meta::specialization_of<Meta::type_list> L, ValidAllocator A, typename F, typename ...P>
+        Entity &Create(A &allocator, const UntypedEntityTemplate &entity_template, F &&ith_list_head, P &&... params)
+        {
+            using entity_type = Meta::list_apply_types<impl::SpecificEntityWithNodes, L>;
+            static_assert(alignof(entity_type) <= component_alignment);
+
+            int node_count = entity_template.GetListHandles().size();
+
+            // Allocate storage.
+            std::size_t storage_size = entity_type::RequiredStorageSize(node_count);
+            char *storage = allocator.Allocate(storage_size);
+            FINALLY_ON_THROW( allocator.Deallocate(storage); )
+
+            // Construct the entity using placement-new.
+            return *new(storage) entity_type(typename entity_type::have_enough_storage{}, node_count, ith_list_head, std::forward<P>(params)...);
+        }
+
+        // Allocates a single block of memory for all entities.
+        // The block is freed when the last of those entities is destroyed.
+        template <Meta::specialization_of<Meta::type_list> L, ValidAllocator A, typename F, typename G>
+        EntityBatch CreateMany(A &allocator, const UntypedEntityTemplate &entity_template, std::size_t count, F &&ith_list_head, G &&initializer)
+        {
+            using entity_type = Meta::list_apply_types<impl::SpecificEntityWithNodes, L>;
+            static_assert(alignof(entity_type) <= component_alignment);
+
+            EntityBatch ret;
+            if (count == 0)
+                return ret;
+
+            int node_count = entity_template.GetListHandles().size();
+
+            // Allocate storage.
+            std::size_t stride = Storage::Align<component_alignment>(entity_type::RequiredStorageSize(node_count));
+            char *storage = allocator.Allocate(stride * count);
+            FINALLY_ON_THROW( allocator.Deallocate(storage); )
+
+            // Register the block.
+            Batch &batch = *batches.insert(std::upper_bound(batches.begin(), batches.end(), storage, CompareBatchBegin{}), Batch{storage, storage + stride * count, 0});
+            FINALLY_ON_THROW( batches.erase(FindBatch(storage)); )
+
+            // Construct the entities using placement-new, destroying the already constructed ones if something throws.
+            std::size_t constructed = 0;
+            FINALLY_ON_THROW(
+                while (constructed-- > 0)
+                    std::launder(reinterpret_cast<entity_type *>(storage + stride * constructed))->~entity_type();
+            )
+            while (constructed < count)
+            {
+                Entity &entity = std::apply([&](auto &&... params) -> Entity &
+                {
+                    return *new(storage + stride * constructed) entity_type(typename entity_type::have_enough_storage{}, node_count, ith_list_head, std::forward<decltype(params)>(params)...);
+                }, initializer(constructed));
+                constructed++;
+                ret.AddEntity(entity);
+            }
+
+            batch.live = count;
+            return ret;
+        }
+
+        template <ValidAllocator A>
+        void Destroy(A &allocator, Entity &entity)
+        {
+            char *storage = reinterpret_cast<char *>(&entity);
+            entity.~Entity();
+
+            if (!batches.empty())
+            {
+                auto it = FindBatch(storage);
+                if (it != batches.end())
+                {
+                    if (--it->live == 0)
+                    {
+                        allocator.Deallocate(it->begin);
+                        batches.erase(it);
+                    }
+                    return;
+                }
+            }
+
+            allocator.Deallocate(storage);
+        }
+
+        // The components are stored inside of the entity object, so we can't change them in place.
+        // Creates a new entity instead, and destroys the old one.
+        template <Meta::specialization_of<Meta::type_list> L, ValidAllocator A, typename F, typename ...P>
+        Entity &Migrate(A &allocator, Entity &entity, const UntypedEntityTemplate &entity_template, F &&ith_list_head, P &&... params)
+        {
+            Entity &ret = Create<L>(allocator, entity_template, ith_list_head, std::forward<P>(params)...);
+            Destroy(allocator, entity);
+            return ret;
+        }
+
+        template <ValidAllocator A>
+        void ReleaseMemory(A &) {}
+
+        template <Meta::specialization_of<Meta::type_list> L>
+        [[nodiscard]] impl::ListNode &GetListNode(Entity &entity, int i) const
+        {
+            return static_cast<Meta::list_apply_types<impl::SpecificEntityWithNodes, L> &>(entity).GetNode(i);
+        }
+
+        template <ValidComponent ...C, typename F>
+        void ForEach(const List &list, std::size_t /*list_index*/, F &&func) const
+        {
+            for (Entity &e : list)
+                func(impl::GetComponentUntracked<C>(e)...);
+        }
+
+        template <ValidRequestedComponent ...C>
+        [[nodiscard]] impl::PerEntityQuery<C...> Query(const List &list, std::size_t /*list_index*/) const
+        {
+            return list;
+        }
+
+        template <ValidComponent ...C, typename Pool, typename F>
+        void ParallelForEach(Pool &pool, const List &list, std::size_t /*list_index*/, std::size_t grain_size, F &&func) const
+        {
+            // We can't split a linked list without walking it, so we collect the entities first.
+            std::vector<Entity *> entities;
+            for (Entity &e : list)
+                entities.push_back(&e);
+
+            pool.ParallelFor(0, entities.size(), grain_size, [&](std::size_t begin, std::size_t end)
+            {
+                for (std::size_t i = begin; i < end; i++)
+                    func(impl::GetComponentUntracked<C>(*entities[i])...);
+            });
+        }
+    };
+
+
     // Returns true if the entity type being described contains a component with the specified index.
     using component_predicate_t = bool(std::type_index);
     // Returns true if the list being described should include entities described by the parameter predicate.
@@ -763,12 +1436,16 @@ namespace Ent
         // A `Meta::type_list` of default components that are added to all entities.
         Meta::specialization_of<Meta::type_list> DefaultComponents = Meta::type_list<>,
         // An allocator for the entities.
-        ValidAllocator Allocator = DefaultAllocator
+        ValidAllocator Allocator = DefaultAllocator,
+        // Determines how the entities are laid out in memory.
+        ValidEntityStorage Storage = PerEntityStorage
     >
     class Controller
     {
         friend class ControllerConfig;
+        friend impl::SnapshotAccess;
         [[no_unique_address]] Allocator allocator;
+        [[no_unique_address]] Storage storage;
 
         struct ListWithPred
         {
@@ -777,10 +1454,45 @@ namespace Ent
         };
         std::vector<ListWithPred> entity_lists;
 
+        // The handle table. Live entities store their slot indices, see `Entity::GetHandleSlot()`.
+        // Free slots form a linked list starting at `first_free_handle_slot`.
+        struct HandleSlot
+        {
+            Entity *entity = nullptr;
+            std::uint32_t generation = 0;
+            std::uint32_t next_free = -1;
+            // For live entities, the index of their set of components in `EntityTypes()`.
+            std::uint32_t type_index = -1;
+        };
+        std::vector<HandleSlot> handle_slots;
+        Meta::ResetIfMovedFrom<std::uint32_t, std::uint32_t(-1)> first_free_handle_slot;
+
         // Entity count, for debugging purposes. Can be removed without affecting anything.
         // A temporary measure, until we figure out a decent customization point to plug this in.
         Meta::ResetIfMovedFrom<std::size_t, 0> entity_count;
 
+        // Type-erased information about a specific set of components that this controller can create, see `EntityTypes()`.
+        struct EntityType
+        {
+            // The IDs of the components (see `ComponentId()`), including the implied and the default ones. Sorted.
+            std::vector<std::size_t> component_ids;
+            UntypedEntityTemplate (*make_template)(Controller &self) = nullptr;
+            // Returns the i-th list node of an entity of this type.
+            impl::ListNode &(*get_list_node)(const Controller &self, Entity &entity, int i) = nullptr;
+            // Gives an entity this set of components, inserting it before `insert_before[i]` in the i-th list of `entity_template`.
+            // A component with the ID `added_id` is moved from `*added`. Other components are moved from the old components of the entity
+            //   if it has them, and are value-initialized otherwise.
+            // Returns the entity, which is either the same object or a new one, see `Storage::Migrate()`. The handle slot is not updated.
+            Entity &(*migrate)(Controller &self, Entity &entity, const UntypedEntityTemplate &entity_template, impl::ListNode *const *insert_before,
+                std::size_t added_id, void *added) = nullptr;
+            // Creates `count` entities of this type with value-initialized components. Throws if some of them aren't default-constructible.
+            EntityBatch (*create_many)(Controller &self, std::size_t count) = nullptr;
+        };
+
+        // The templates for `EntityTypes()`, indexed the same way. Created on the first use, see `GetEntityTypeTemplate()`.
+        // Allocated separately, to keep the references to them valid when the vector grows.
+        std::vector<std::unique_ptr<UntypedEntityTemplate>> entity_type_templates;
+
       public:
         // Default-constructible (assuming the allocator is default-constructible),
         // but needs to be configured with `ControllerConfig` before use.
@@ -798,6 +1510,7 @@ namespace Ent
         ~Controller()
         {
             DestroyAllEntities();
+            storage.ReleaseMemory(allocator);
         }
 
 
@@ -819,6 +1532,10 @@ namespace Ent
         [[nodiscard]]       Allocator &GetAllocator()       {return allocator;}
         [[nodiscard]] const Allocator &GetAllocator() const {return allocator;}
 
+        // Returns the storage.
+        [[nodiscard]]       Storage &GetStorage()       {return storage;}
+        [[nodiscard]] const Storage &GetStorage() const {return storage;}
+
         // Returns the current entity count.
         [[nodiscard]] std::size_t GetEntityCount() const {return entity_count.value;}
 
@@ -859,12 +1576,45 @@ namespace Ent
             return ret;
         }
 
+        // Returns a handle for the entity, which can be stored and later converted back to the entity with `TryGet()`.
+        // The entity must belong to this controller.
+        [[nodiscard]] EntityHandle GetHandle(const Entity &entity) const
+        {
+            std::uint32_t slot_index = entity.GetHandleSlot();
+            return EntityHandle::Construct(slot_index, handle_slots[slot_index].generation);
+        }
+
+        // Returns the entity that the handle points to, or null if it was destroyed or if the handle is null.
+        [[nodiscard]] Entity *TryGet(EntityHandle handle) const
+        {
+            if (handle.GetIndex() >= handle_slots.size())
+                return nullptr;
+            const HandleSlot &slot = handle_slots[handle.GetIndex()];
+            return slot.generation == handle.GetGeneration() ? slot.entity : nullptr;
+        }
+
+        // Same as `TryGet()`, but throws if the entity doesn't exist.
+        [[nodiscard]] Entity &Get(EntityHandle handle) const
+        {
+            Entity *ret = TryGet(handle);
+            if (!ret)
+                Program::Error(handle ? "Attempt to use a handle to a destroyed entity." : "Attempt to use a null entity handle.");
+            return *ret;
+        }
+
         // Destroys a single entity.
         // WARNING: This invalidates any list iterators pointing to that entity.
         void Destroy(Entity &entity)
         {
-            entity.~Entity();
-            allocator.Deallocate(reinterpret_cast<char *>(&entity));
+            // Free the handle slot. Incrementing the generation invalidates the existing handles.
+            std::uint32_t slot_index = entity.GetHandleSlot();
+            HandleSlot &slot = handle_slots[slot_index];
+            slot.entity = nullptr;
+            slot.generation++;
+            slot.next_free = first_free_handle_slot.value;
+            first_free_handle_slot.value = slot_index;
+
+            storage.Destroy(allocator, entity);
             entity_count.value--;
         }
         // Destroys all entities in the specified list.
@@ -887,6 +1637,62 @@ namespace Ent
                 DestroyListed(ListHandle::ConstructFromIndex(i));
         }
 
+        // Calls `func(C &...)` for every entity in the specified list. Throws if some of them lack the components.
+        // Depending on the storage, this can be much faster than iterating over the list and calling `.get<C>()` manually.
+        // The components that inherit from `TrackChanges` are marked as changed, like with non-const `.get<C>()`,
+        //   unless they are requested as const: `ForEach<const Pos, Vel>(list, [](const Pos &pos, Vel &vel){...})`.
+        // The iteration order is unspecified, and the entities must not be created or destroyed during iteration.
+        template <ValidRequestedComponent ...C, typename F>
+        void ForEach(ListHandle list_handle, F &&func) const
+        {
+            storage.template ForEach<std::remove_const_t<C>...>(operator()(list_handle), list_handle.GetIndex(), [&](std::remove_const_t<C> &... components)
+            {
+                func(impl::MarkChangedIfTracked<C>(components)...);
+            });
+        }
+
+        // Same as `ForEach<T, C...>()`, but only calls `func(T &, C &...)` for entities whose `T` changed after the tick `since` ended.
+        // Only the non-const components of those entities are marked as changed.
+        // `T` must inherit from `TrackChanges`. See `AdvanceChangeTick()` for how to pick `since`.
+        // Note that this is a linear scan: it visits every entity in the list and checks its stamp, and only skips calling `func`.
+        //   If only a few of many entities change per tick, it can be better to collect the changed ones into a separate container.
+        template <ValidRequestedComponent T, ValidRequestedComponent ...C, typename F>
+        void ForEachChanged(ListHandle list_handle, std::uint64_t since, F &&func) const
+        {
+            static_assert(std::derived_from<T, TrackChanges>, "The component must inherit from `TrackChanges` to use this function.");
+            storage.template ForEach<std::remove_const_t<T>, std::remove_const_t<C>...>(operator()(list_handle), list_handle.GetIndex(),
+                [&](std::remove_const_t<T> &changed, std::remove_const_t<C> &... components)
+            {
+                if (changed.ChangedSince(since))
+                    func(impl::MarkChangedIfTracked<T>(changed), impl::MarkChangedIfTracked<C>(components)...);
+            });
+        }
+
+        // Returns a range of `std::tuple<C &...>`, one for each entity in the list that has all of `C...`.
+        // The entities that lack some of the components are skipped, so this can be used to narrow down a broader list.
+        // The components that inherit from `TrackChanges` are marked as changed when the iterator is dereferenced, unless they're requested as const.
+        // Use it with structured bindings: `for (auto [pos, vel] : c.Query<const Pos, Vel>(list)) {...}`.
+        // The component locations are resolved once per entity type (or per chunk), rather than for each `.get<T>()`.
+        // The iteration order is unspecified, and the entities must not be created or destroyed during iteration.
+        template <ValidRequestedComponent ...C>
+        [[nodiscard]] auto Query(ListHandle list_handle) const
+        {
+            return storage.template Query<C...>(operator()(list_handle), list_handle.GetIndex());
+        }
+
+        // Same as `ForEach()`, but processes the entities in parallel, in batches of approximately `grain_size` entities.
+        // `pool` is a `ThreadPool` (see `utils/thread_pool.h`), or anything else with a compatible `ParallelFor()`.
+        // `func` must be safe to call concurrently for different entities. Blocks until all entities are processed.
+        template <ValidRequestedComponent ...C, typename Pool, typename F>
+        void ParallelForEach(Pool &pool, ListHandle list_handle, F &&func, std::size_t grain_size = 256) const
+        {
+            storage.template ParallelForEach<std::remove_const_t<C>...>(pool, operator()(list_handle), list_handle.GetIndex(), grain_size,
+                [&](std::remove_const_t<C> &... components)
+            {
+                func(impl::MarkChangedIfTracked<C>(components)...);
+            });
+        }
+
         // Create an entity using a template.
         // The `params` is a list of components, a subset of `C...`.
         // The matching components from `C...` are initialized from those, and other components are value-initialized.
@@ -910,6 +1716,60 @@ namespace Ent
             return CreateFromUntypedTemplate<C...>(template_cache.template GetTemplate<Meta::type_list<C...>>(lambda), std::forward<P>(params)...);
         }
 
+        // Creates `count` entities using a template. The storage tries to allocate memory for all of them at once,
+        //   e.g. `PerEntityStorage` uses a single allocation for the whole batch.
+        // `initializer` is `func(std::size_t i)`. It returns a `std::tuple` of component initializers for the i-th entity,
+        //   which are treated the same way as `params` of `Create()`.
+        // Returns the range of the created entities, in the same order.
+        // If something throws, the entities created so far are destroyed.
+        template <ValidComponent ...C, typename F>
+        EntityBatch CreateMany(const EntityTemplate<C...> &entity_template, std::size_t count, F &&initializer)
+        {
+            return CreateManyFromUntypedTemplate<C...>(entity_template, count, std::forward<F>(initializer));
+        }
+        // Same, but all components are value-initialized.
+        template <ValidComponent ...C>
+        EntityBatch CreateMany(const EntityTemplate<C...> &entity_template, std::size_t count)
+        {
+            return CreateMany(entity_template, count, [](std::size_t){return std::tuple<>{};});
+        }
+
+        // Adds a component `T` to an entity, initializing it from `value`.
+        // `C...` are the components the entity currently has, in any order. The default and the implied ones can be omitted.
+        // Knowing them at compile time lets us register the new set of components (see `EntityTypes()`) right here.
+        // Throws if the entity has a different set of components.
+        // The components implied by `T` that the entity lacks are added too, and are value-initialized.
+        // The existing components are moved to their new place. The entity keeps its position in the lists it stays in,
+        //   and is appended to the lists it joins.
+        // The storage decides whether the entity object itself stays in place: `ChunkedStorage` keeps it, so the references to it stay valid,
+        //   while `PerEntityStorage` stores the components inside of the entity, so it has to replace it with a new one.
+        // The handle of the entity (see `GetHandle()`) is preserved in any case. Returns the entity.
+        // If a component constructor throws, the entity is kept as is, but some of its components can be left in a moved-from state.
+        template <ValidComponent T, ValidComponent ...C>
+        Entity &AddComponent(Entity &entity, T value = T{})
+        {
+            using old_components = created_component_list<C...>;
+            using new_components = created_component_list<C..., T>;
+            static_assert(!Meta::list_contains_type<old_components, T>, "The entity already has this component.");
+
+            std::size_t old_type = GetEntityTypeChecked<old_components>(entity);
+            return MigrateEntity(entity, old_type, entity_type_index<new_components>, ComponentId<T>(), &value);
+        }
+        // Removes a component `T` from an entity. `C...` are the components the entity currently has, see `AddComponent()`.
+        // `T` can't be a default component, or be implied by other components of the entity.
+        // Otherwise works like `AddComponent()`.
+        template <ValidComponent T, ValidComponent ...C>
+        Entity &RemoveComponent(Entity &entity)
+        {
+            using old_components = created_component_list<C...>;
+            using new_components = Meta::list_apply_types<created_component_list, typename impl::RemoveComponentFromList<T, old_components>::type>;
+            static_assert(Meta::list_contains_type<old_components, T>, "The entity doesn't have this component.");
+            static_assert(!Meta::list_contains_type<new_components, T>, "This component is a default one, or is implied by other components of the entity.");
+
+            std::size_t old_type = GetEntityTypeChecked<old_components>(entity);
+            return MigrateEntity(entity, old_type, entity_type_index<new_components>, std::size_t(-1), nullptr);
+        }
+
         // Makes an "entity template".
         // A template is necessary to create an entity with a specific set of components.
         // Templates are exposed solely to allow them to be cached by the user.
@@ -941,6 +1801,127 @@ namespace Ent
         }
 
       private:
+        // All sets of components that this controller can create, i.e. the sets passed to `Create()`, `CreateMany()`,
+        //   `AddComponent()` or `RemoveComponent()` anywhere in the program.
+        // Filled during static initialization, see `entity_type_index`. This is what lets `AddComponent()` and the snapshots (see `entities/snapshot.h`) work without static types.
+        [[nodiscard]] static std::vector<EntityType> &EntityTypes()
+        {
+            static std::vector<EntityType> ret;
+            return ret;
+        }
+
+        // Makes the type-erased information about the components `L` (the full list, including the default components).
+        template <Meta::specialization_of<Meta::type_list> L>
+        [[nodiscard]] static EntityType MakeEntityType()
+        {
+            return []<typename ...C>(Meta::type_list<C...>)
+            {
+                EntityType ret;
+                ret.component_ids = {ComponentId<C>()...};
+                std::sort(ret.component_ids.begin(), ret.component_ids.end());
+
+                ret.make_template = [](Controller &self)
+                {
+                    return UntypedEntityTemplate(self.MakeEntityTemplate<C...>());
+                };
+                ret.get_list_node = [](const Controller &self, Entity &entity, int i) -> impl::ListNode &
+                {
+                    return self.storage.template GetListNode<L>(entity, i);
+                };
+                ret.migrate = [](Controller &self, Entity &entity, const UntypedEntityTemplate &entity_template, impl::ListNode *const *insert_before,
+                    std::size_t added_id, void *added) -> Entity &
+                {
+                    // Holds the components that neither `added` nor the old entity provide.
+                    std::tuple<std::optional<C>...> new_components;
+
+                    auto source = [&]<typename T>(Meta::tag<T>) -> T &&
+                    {
+                        if (ComponentId<T>() == added_id)
+                            return std::move(*static_cast<T *>(added));
+                        if (entity.has<T>())
+                            return std::move(impl::GetComponentUntracked<T>(entity));
+                        if constexpr (std::default_initializable<T>)
+                            return std::move(std::get<std::optional<T>>(new_components).emplace());
+                        else
+                            Program::Error(FMT("Unable to add component `{}` to an entity, because it's not default-constructible.", Meta::TypeName<T>()));
+                    };
+
+                    auto ith_list_head = [&](int i) noexcept -> impl::ListNode &
+                    {
+                        return *insert_before[i];
+                    };
+                    return self.storage.template Migrate<L>(self.allocator, entity, entity_template, ith_list_head, source(Meta::tag<C>{})...);
+                };
+                if constexpr ((std::default_initializable<C> && ...))
+                {
+                    ret.create_many = [](Controller &self, std::size_t count)
+                    {
+                        return self.CreateMany(self.MakeEntityTemplate<C...>(), count);
+                    };
+                }
+                else
+                {
+                    ret.create_many = [](Controller &, std::size_t) -> EntityBatch
+                    {
+                        Program::Error("Unable to create entities with value-initialized components, because some of them are not default-constructible.");
+                    };
+                }
+
+                return ret;
+            }(L{});
+        }
+
+        // Returns the index of the set of components of `entity` in `EntityTypes()`. It's stored in the handle slot of the entity.
+        [[nodiscard]] std::size_t GetEntityType(const Entity &entity) const
+        {
+            std::uint32_t slot_index = entity.GetHandleSlot();
+            ASSERT(slot_index < handle_slots.size() && handle_slots[slot_index].entity == &entity, "The entity doesn't belong to this controller.");
+            return handle_slots[slot_index].type_index;
+        }
+
+        // Same as `GetEntityType()`, but throws if the entity doesn't have exactly the components `L` (the full list).
+        template <Meta::specialization_of<Meta::type_list> L>
+        [[nodiscard]] std::size_t GetEntityTypeChecked(const Entity &entity) const
+        {
+            std::size_t type = GetEntityType(entity);
+            std::size_t expected_type = entity_type_index<L>;
+            // Different lists can describe the same set, so compare the component IDs if the indices differ.
+            if (type != expected_type && EntityTypes()[type].component_ids != EntityTypes()[expected_type].component_ids)
+                Program::Error("The entity doesn't have exactly the specified components.");
+            return type;
+        }
+
+        // Returns the index of the set of components `component_ids` (sorted) in `EntityTypes()`, or -1 if it's not registered.
+        [[nodiscard]] static std::size_t FindEntityType(const std::vector<std::size_t> &component_ids)
+        {
+            const std::vector<EntityType> &types = EntityTypes();
+            auto it = std::find_if(types.begin(), types.end(), [&](const EntityType &type){return type.component_ids == component_ids;});
+            return it == types.end() ? std::size_t(-1) : it - types.begin();
+        }
+
+        // Returns the template for `EntityTypes()[type_index]`, creating it on the first use.
+        [[nodiscard]] const UntypedEntityTemplate &GetEntityTypeTemplate(std::size_t type_index)
+        {
+            if (type_index >= entity_type_templates.size())
+                entity_type_templates.resize(EntityTypes().size());
+            std::unique_ptr<UntypedEntityTemplate> &ret = entity_type_templates[type_index];
+            if (!ret)
+                ret = std::make_unique<UntypedEntityTemplate>(EntityTypes()[type_index].make_template(*this));
+            return *ret;
+        }
+
+        // The index of the components `L` (the full list) in `EntityTypes()`.
+        // Must be odr-used for each set of components this controller creates, which adds it to `EntityTypes()` during static initialization.
+        template <Meta::specialization_of<Meta::type_list> L>
+        inline static const std::size_t entity_type_index = []{
+            EntityTypes().push_back(MakeEntityType<L>());
+            return EntityTypes().size() - 1;
+        }();
+
+        // The full list of components of the entities created by `Create<C...>()`.
+        template <ValidComponent ...C>
+        using created_component_list = Meta::list_apply_types<full_component_list, Meta::list_cat<DefaultComponents, Meta::type_list<C...>>>;
+
         template <ValidComponent ...C, typename ...P>
         Entity &CreateFromUntypedTemplate(const UntypedEntityTemplate &entity_template, P &&... params)
         {
@@ -952,26 +1933,112 @@ namespace Ent
             if (list_handles.empty())
                 Program::Error("Refuse to create an entity that doesn't belong to any lists.");
 
-            // Determine a full list of the components, and the actual entity type.
-            using components = Meta::list_apply_types<full_component_list, Meta::list_cat<DefaultComponents, Meta::type_list<C...>>>;
-            using entity_type = Meta::list_apply_types<impl::SpecificEntityWithNodes, components>;
-            static_assert(alignof(entity_type) <= component_alignment);
+            // Determine a full list of the components.
+            using components = created_component_list<C...>;
 
-            // Allocate storage.
-            std::size_t storage_size = entity_type::RequiredStorageSize(list_handles.size());
-            char *storage = allocator.Allocate(storage_size);
-            FINALLY_ON_THROW( allocator.Deallocate(storage); )
+            // Make sure that adding a handle slot later can't throw.
+            if (first_free_handle_slot.value == std::uint32_t(-1))
+                impl::ReserveExtra(handle_slots, 1);
 
-            // Construct the entity using placement-new.
+            // Construct the entity.
             auto ith_list_head = [&](int i) noexcept -> impl::ListNode &
             {
                 return const_cast<List &>(operator()(list_handles[i]));
             };
-            entity_type *entity = new(storage) entity_type(typename entity_type::have_enough_storage{}, list_handles.size(), ith_list_head, std::forward<P>(params)...);
+            Entity &entity = storage.template Create<components>(allocator, entity_template, ith_list_head, std::forward<P>(params)...);
 
+            AssignHandleSlot(entity, entity_type_index<components>);
             entity_count.value++;
 
-            return *entity;
+            return entity;
+        }
+
+        template <ValidComponent ...C, typename F>
+        EntityBatch CreateManyFromUntypedTemplate(const UntypedEntityTemplate &entity_template, std::size_t count, F &&initializer)
+        {
+            const auto &list_handles = entity_template.GetListHandles();
+
+            // See `CreateFromUntypedTemplate()`.
+            if (list_handles.empty())
+                Program::Error("Refuse to create an entity that doesn't belong to any lists.");
+
+            using components = created_component_list<C...>;
+
+            // Make sure that adding the handle slots later can't throw.
+            impl::ReserveExtra(handle_slots, count);
+
+            auto ith_list_head = [&](int i) noexcept -> impl::ListNode &
+            {
+                return const_cast<List &>(operator()(list_handles[i]));
+            };
+            EntityBatch batch = storage.template CreateMany<components>(allocator, entity_template, count, ith_list_head, std::forward<F>(initializer));
+
+            for (Entity &entity : batch)
+                AssignHandleSlot(entity, entity_type_index<components>);
+            entity_count.value += count;
+
+            return batch;
+        }
+
+        // Changes the set of components of an entity from `EntityTypes()[old_type]` to `EntityTypes()[new_type]`.
+        // `added_id` and `added` are passed to `EntityType::migrate`. See `AddComponent()` for details.
+        Entity &MigrateEntity(Entity &entity, std::size_t old_type, std::size_t new_type, std::size_t added_id, void *added)
+        {
+            const std::vector<EntityType> &types = EntityTypes();
+
+            const auto &old_handles = GetEntityTypeTemplate(old_type).GetListHandles();
+            const UntypedEntityTemplate &new_template = GetEntityTypeTemplate(new_type);
+            const auto &new_handles = new_template.GetListHandles();
+
+            // See `CreateFromUntypedTemplate()`.
+            if (new_handles.empty())
+                Program::Error("Refuse to create an entity that doesn't belong to any lists.");
+
+            // For each list of the new entity, find the node it should be inserted before:
+            //   the node of the old entity if it's in the same list (so the new one takes its place), or the list head otherwise.
+            // Both handle lists are sorted by the list index, since that's how `MakeEntityTemplate()` makes them.
+            std::vector<impl::ListNode *> insert_before(new_handles.size());
+            std::size_t old_index = 0;
+            for (std::size_t i = 0; i < new_handles.size(); i++)
+            {
+                while (old_index < old_handles.size() && old_handles[old_index].GetIndex() < new_handles[i].GetIndex())
+                    old_index++;
+                if (old_index < old_handles.size() && old_handles[old_index].GetIndex() == new_handles[i].GetIndex())
+                    insert_before[i] = &types[old_type].get_list_node(*this, entity, old_index);
+                else
+                    insert_before[i] = &static_cast<impl::ListNode &>(const_cast<List &>(operator()(new_handles[i])));
+            }
+
+            std::uint32_t slot_index = entity.GetHandleSlot();
+            Entity &new_entity = types[new_type].migrate(*this, entity, new_template, insert_before.data(), added_id, added);
+
+            // The storage either keeps the entity in place, or replaces it with a new one. Either way, it keeps the handle slot.
+            HandleSlot &slot = handle_slots[slot_index];
+            slot.entity = &new_entity;
+            slot.type_index = new_type;
+            new_entity.SetHandleSlot(slot_index);
+
+            return new_entity;
+        }
+
+        // Gives a handle slot to a new entity.
+        // `type_index` is the index of the set of components of the entity in `EntityTypes()`.
+        // The caller must make sure that `handle_slots` has enough capacity, so that this doesn't throw.
+        void AssignHandleSlot(Entity &entity, std::size_t type_index) noexcept
+        {
+            std::uint32_t slot_index = first_free_handle_slot.value;
+            if (slot_index == std::uint32_t(-1))
+            {
+                slot_index = handle_slots.size();
+                handle_slots.emplace_back();
+            }
+            else
+            {
+                first_free_handle_slot.value = handle_slots[slot_index].next_free;
+            }
+            handle_slots[slot_index].entity = &entity;
+            handle_slots[slot_index].type_index = type_index;
+            entity.SetHandleSlot(slot_index);
         }
     };
 
@@ -0,0 +1,788 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "entities/base.h"
+#include "macros/finally.h"
+#include "meta/lists.h"
+#include "meta/misc.h"
+#include "program/errors.h"
+#include "utils/alignment.h"
+#include "utils/simple_iterator.h"
+
+/* An alternative entity storage for `Ent::Controller`.
+ *
+ * Entities are grouped by their component sets ("archetypes"). Each archetype owns a list of fixed-size chunks.
+ * Each chunk stores several entities, with a separate contiguous array ("column") for each component type.
+ *
+ * The `Entity` objects themselves (along with their list nodes) are allocated separately, and each chunk has an array of pointers to them.
+ * They merely point to their components, so `List`s, `.get<T>()` and so on keep working as usual.
+ *
+ * Entities never move after they're created. Destroyed entities leave holes in the chunks, which are reused by the next
+ * entities of the same archetype. `Controller::ForEach()` walks the columns linearly and skips the holes.
+ * `Controller::AddComponent()` and `RemoveComponent()` move the components to a different archetype,
+ * but the `Entity` object stays in place, so the references to it stay valid.
+ *
+ * Usage:
+ *     using controller_t = Ent::Controller<Meta::type_list<>, Ent::DefaultAllocator, Ent::ChunkedStorage<>>;
+ */
+
+namespace Ent
+{
+    namespace impl
+    {
+        class Archetype;
+
+        // A header at the beginning of every storage chunk.
+        // It's followed by `column_count + 1` offsets (one for each column, then one for the owner array, see `Archetype::OwnerStorage()`),
+        //   and then by `(capacity + 63) / 64` words of the "alive" bit mask.
+        struct ChunkHeader
+        {
+            Archetype *archetype = nullptr;
+
+            // Max amount of entities in this chunk.
+            std::uint32_t capacity = 0;
+            // Slots `[0, used)` were occupied at least once. Slots past that are untouched.
+            std::uint32_t used = 0;
+            // The amount of live entities.
+            std::uint32_t alive = 0;
+            // Index of the first free slot below `used`, or -1 if none.
+            // The free slots form a linked list, each stores the index of the next one in its element of the owner array.
+            std::uint32_t first_free = -1;
+            // Whether this chunk is listed in `Archetype::open_chunks`.
+            bool is_open = false;
+
+            [[nodiscard]] std::size_t *Offsets()
+            {
+                return reinterpret_cast<std::size_t *>(reinterpret_cast<char *>(this) + Storage::Align<alignof(std::size_t)>(sizeof(ChunkHeader)));
+            }
+            [[nodiscard]] const std::size_t *Offsets() const
+            {
+                return const_cast<ChunkHeader *>(this)->Offsets();
+            }
+
+            [[nodiscard]] std::uint64_t *AliveMask(std::size_t column_count)
+            {
+                return reinterpret_cast<std::uint64_t *>(Offsets() + column_count + 1);
+            }
+            [[nodiscard]] const std::uint64_t *AliveMask(std::size_t column_count) const
+            {
+                return const_cast<ChunkHeader *>(this)->AliveMask(column_count);
+            }
+
+            // Returns a pointer to the storage of the `index`-th element of the `column`-th column.
+            // The owner array counts as a column with index `column_count`, with element size `sizeof(ChunkedEntity *)`.
+            [[nodiscard]] char *ElementStorage(std::size_t column, std::size_t elem_size, std::size_t index)
+            {
+                return reinterpret_cast<char *>(this) + Offsets()[column] + elem_size * index;
+            }
+        };
+
+        // The amount of memory needed for a chunk header, followed by the offsets and the alive mask.
+        [[nodiscard]] inline std::size_t ChunkHeaderSize(std::size_t column_count, std::size_t capacity)
+        {
+            return Storage::Align<alignof(std::size_t)>(sizeof(ChunkHeader)) + sizeof(std::size_t) * (column_count + 1) + sizeof(std::uint64_t) * ((capacity + 63) / 64);
+        }
+
+        class ChunkedEntity;
+
+        // Stores all chunks for a specific set of components.
+        class Archetype
+        {
+            // Component IDs (see `ComponentId()`), in the order of the columns.
+            std::vector<std::size_t> component_ids;
+            // Maps the component IDs to the column indices.
+            ComponentTable columns_by_id;
+            // Component sizes, in the order of the columns.
+            std::vector<std::size_t> component_sizes;
+            // Component destructors, in the order of the columns.
+            std::vector<void (*)(void *)> component_destructors;
+            // Indices of the lists that the entities of this archetype belong to. Sorted.
+            std::vector<std::size_t> list_indices;
+            // The size of a single chunk.
+            std::size_t chunk_size = 0;
+            // The amount of entities per chunk, and the layout of each chunk.
+            std::uint32_t capacity = 0;
+            std::vector<std::size_t> offsets;
+
+            // All chunks, in the order of creation.
+            std::vector<ChunkHeader *> chunks;
+            // Chunks that have free slots.
+            std::vector<ChunkHeader *> open_chunks;
+
+            // Returns the storage of the `index`-th element of the owner array of the chunk.
+            // Live slots store `ChunkedEntity *`. Free slots store `std::uint32_t`, see `ChunkHeader::first_free`.
+            [[nodiscard]] char *OwnerStorage(ChunkHeader *chunk, std::uint32_t index) const
+            {
+                return chunk->ElementStorage(ColumnCount(), sizeof(ChunkedEntity *), index);
+            }
+
+          public:
+            // All vectors except `list_indices` are indexed by the column. `list_indices` must be sorted.
+            Archetype(std::vector<std::size_t> component_ids, std::vector<std::size_t> component_sizes, std::vector<void (*)(void *)> component_destructors,
+                std::vector<std::size_t> list_indices, std::size_t chunk_size)
+                : component_ids(std::move(component_ids)), component_sizes(std::move(component_sizes)), component_destructors(std::move(component_destructors)),
+                list_indices(std::move(list_indices)), chunk_size(chunk_size)
+            {
+                std::size_t column_count = this->component_ids.size();
+
+                for (std::size_t i = 0; i < column_count; i++)
+                    columns_by_id.Set(this->component_ids[i], i);
+
+                // Computes the offsets of all columns for the specified capacity, and returns the total chunk size.
+                auto ComputeLayout = [&](std::uint32_t cap) -> std::size_t
+                {
+                    offsets.clear();
+                    std::size_t pos = ChunkHeaderSize(column_count, cap);
+                    for (std::size_t i = 0; i <= column_count; i++)
+                    {
+                        pos = Storage::Align<component_alignment>(pos);
+                        offsets.push_back(pos);
+                        pos += (i < column_count ? this->component_sizes[i] : sizeof(ChunkedEntity *)) * cap;
+                    }
+                    return pos;
+                };
+
+                // Start from an upper estimate, and decrease the capacity until everything fits.
+                std::size_t bytes_per_entity = sizeof(ChunkedEntity *);
+                for (std::size_t size : this->component_sizes)
+                    bytes_per_entity += size;
+                capacity = chunk_size / bytes_per_entity;
+                while (capacity > 0 && ComputeLayout(capacity) > chunk_size)
+                    capacity--;
+
+                if (capacity == 0)
+                    Program::Error(FMT("An entity with {} components is too large to fit into a {}-byte chunk.", column_count, chunk_size));
+            }
+
+            Archetype(const Archetype &) = delete;
+            Archetype &operator=(const Archetype &) = delete;
+
+            ~Archetype()
+            {
+                ASSERT(chunks.empty(), "The chunks must be freed with `ReleaseMemory()` before destroying an archetype.");
+            }
+
+            [[nodiscard]] std::size_t ColumnCount() const {return component_ids.size();}
+            [[nodiscard]] std::uint32_t Capacity() const {return capacity;}
+            [[nodiscard]] const std::vector<ChunkHeader *> &Chunks() const {return chunks;}
+
+            // Returns the column index of the component with the specified ID, or -1 if none.
+            [[nodiscard]] std::size_t FindColumn(std::size_t component_id) const noexcept
+            {
+                return columns_by_id.Get(component_id);
+            }
+
+            // Returns a pointer to the component with the specified ID in a slot of a chunk, or null if none.
+            [[nodiscard]] const void *ComponentPtr(ChunkHeader *chunk, std::uint32_t index, std::size_t component_id) const noexcept
+            {
+                std::size_t column = FindColumn(component_id);
+                if (column == std::size_t(-1))
+                    return nullptr;
+                return chunk->ElementStorage(column, component_sizes[column], index);
+            }
+
+            // Destroys the components in a slot of a chunk, in the reverse order.
+            void DestroyComponents(ChunkHeader *chunk, std::uint32_t index) const noexcept
+            {
+                for (std::size_t column = ColumnCount(); column-- > 0;)
+                    component_destructors[column](chunk->ElementStorage(column, component_sizes[column], index));
+            }
+
+            // Checks if the entities of this archetype belong to the list.
+            [[nodiscard]] bool IsInList(std::size_t list_index) const
+            {
+                return std::binary_search(list_indices.begin(), list_indices.end(), list_index);
+            }
+
+            // Reserves a slot for a new entity, possibly allocating a new chunk.
+            // The slot is not marked as alive until `CommitSlot()` is called. If you don't call it, the slot stays free.
+            template <ValidAllocator A>
+            [[nodiscard]] std::pair<ChunkHeader *, std::uint32_t> ReserveSlot(A &allocator)
+            {
+                if (open_chunks.empty())
+                {
+                    char *memory = allocator.Allocate(chunk_size);
+                    FINALLY_ON_THROW( allocator.Deallocate(memory); )
+                    ReserveExtra(chunks, 1);
+                    open_chunks.reserve(chunks.capacity());
+
+                    ChunkHeader *chunk = ::new(memory) ChunkHeader;
+                    chunk->archetype = this;
+                    chunk->capacity = capacity;
+                    chunk->is_open = true;
+                    std::copy(offsets.begin(), offsets.end(), chunk->Offsets());
+                    std::fill_n(chunk->AliveMask(ColumnCount()), (capacity + 63) / 64, 0);
+
+                    chunks.push_back(chunk);
+                    open_chunks.push_back(chunk);
+                }
+
+                ChunkHeader *chunk = open_chunks.back();
+                std::uint32_t index;
+                if (chunk->first_free != std::uint32_t(-1))
+                    index = chunk->first_free;
+                else
+                    index = chunk->used;
+                return {chunk, index};
+            }
+
+            // Marks a slot returned by `ReserveSlot()` as alive, and remembers the entity that owns it. Doesn't throw.
+            void CommitSlot(ChunkHeader *chunk, std::uint32_t index, ChunkedEntity *owner) noexcept
+            {
+                if (index == chunk->first_free)
+                    chunk->first_free = *std::launder(reinterpret_cast<std::uint32_t *>(OwnerStorage(chunk, index)));
+                else
+                    chunk->used++;
+
+                ::new(OwnerStorage(chunk, index)) ChunkedEntity *(owner);
+                chunk->AliveMask(ColumnCount())[index / 64] |= std::uint64_t(1) << (index % 64);
+                chunk->alive++;
+
+                if (chunk->alive == chunk->capacity)
+                {
+                    chunk->is_open = false;
+                    open_chunks.pop_back(); // The chunk is always at the back, see `ReserveSlot()`.
+                }
+            }
+
+            // Releases the slot of a destroyed entity. The components must already be destroyed.
+            // We keep the last empty chunk around, to avoid allocation churn when entities are repeatedly created and destroyed.
+            template <ValidAllocator A>
+            void ReleaseSlot(A &allocator, ChunkHeader *chunk, std::uint32_t index) noexcept
+            {
+                chunk->AliveMask(ColumnCount())[index / 64] &= ~(std::uint64_t(1) << (index % 64));
+                chunk->alive--;
+
+                if (chunk->alive == 0 && chunks.size() > 1)
+                {
+                    FreeChunk(allocator, chunk);
+                    return;
+                }
+
+                ::new(OwnerStorage(chunk, index)) std::uint32_t(chunk->first_free);
+                chunk->first_free = index;
+
+                if (!chunk->is_open)
+                {
+                    chunk->is_open = true;
+                    open_chunks.push_back(chunk); // This doesn't throw, since we reserve enough capacity in `ReserveSlot()`.
+                }
+            }
+
+            // Frees all chunks. There must be no live entities.
+            template <ValidAllocator A>
+            void ReleaseMemory(A &allocator) noexcept
+            {
+                while (!chunks.empty())
+                    FreeChunk(allocator, chunks.back());
+            }
+
+          private:
+            template <ValidAllocator A>
+            void FreeChunk(A &allocator, ChunkHeader *chunk) noexcept
+            {
+                ASSERT(chunk->alive == 0, "Attempt to free a non-empty chunk.");
+                chunks.erase(std::find(chunks.begin(), chunks.end(), chunk));
+                if (chunk->is_open)
+                    open_chunks.erase(std::find(open_chunks.begin(), open_chunks.end(), chunk));
+                chunk->~ChunkHeader();
+                allocator.Deallocate(reinterpret_cast<char *>(chunk));
+            }
+        };
+
+        // An entity stored in a chunk. Its components are stored in the columns of the chunk, and it merely points to them.
+        // The entity object is allocated separately, followed by its list nodes, like `SpecificEntityWithNodes`.
+        // It doesn't depend on the component types, so `ChunkedStorage::Migrate()` can move the components to a different archetype,
+        //   while keeping the entity object in place.
+        class ChunkedEntity final : public Entity
+        {
+            ChunkHeader *chunk = nullptr;
+            std::uint32_t index = 0;
+            // The amount of lists that this object is a part of.
+            int node_count = 0;
+            // The list nodes. Normally they follow this object in memory, but `ReplaceNodes()` can move them to a separate allocation.
+            ListNode *nodes = nullptr;
+
+            __attribute__((pure)) // See `Entity` for the explanation of this attribute. It can't be `const`, since the components can move.
+            const void *GetComponentPtr(std::size_t component_id) const noexcept override final
+            {
+                return chunk->archetype->ComponentPtr(chunk, index, component_id);
+            }
+
+            [[nodiscard]] char *InlineNodeStorage() const
+            {
+                return const_cast<char *>(reinterpret_cast<const char *>(this)) + RequiredStorageSize(0);
+            }
+
+          public:
+            struct have_enough_storage {};
+            // YOU MUST INVOKE THIS CONSTRUCTOR USING PLACEMENT NEW, AND HAVE ENOUGH STORAGE ALLOCATED, SEE `RequiredStorageSize()`.
+            // The components must already be constructed in the slot `index` of the chunk.
+            // `func` is `ListNode &func(int i)`, see `SpecificEntityWithNodes` for details.
+            template <typename F>
+            explicit ChunkedEntity(have_enough_storage, ChunkHeader *chunk, std::uint32_t index, int node_count, F &&func)
+                requires(noexcept(func(int{})))
+                : chunk(chunk), index(index), node_count(node_count), nodes(reinterpret_cast<ListNode *>(InlineNodeStorage()))
+            {
+                for (int i = 0; i < node_count; i++)
+                    ::new(nodes + i) ListNode(ListNode::insert_before{}, func(i), this);
+            }
+
+            // Destroys the owned nodes. The components are destroyed by the storage, see `Archetype::DestroyComponents()`.
+            ~ChunkedEntity()
+            {
+                for (int i = 0; i < node_count; i++)
+                    GetNode(i).~ListNode();
+            }
+
+            [[nodiscard]] ChunkHeader *Chunk() const {return chunk;}
+            [[nodiscard]] std::uint32_t Index() const {return index;}
+
+            // Points the entity to a different slot, after its components were moved there.
+            void SetSlot(ChunkHeader *new_chunk, std::uint32_t new_index)
+            {
+                chunk = new_chunk;
+                index = new_index;
+            }
+
+            // The amount of memory needed to store an instance of this class, followed by `node_count` nodes.
+            [[nodiscard]] static std::size_t RequiredStorageSize(int node_count)
+            {
+                return Storage::Align<alignof(ListNode)>(sizeof(ChunkedEntity)) + sizeof(ListNode) * node_count;
+            }
+
+            [[nodiscard]] ListNode &GetNode(int i)
+            {
+                ASSERT(i >= 0 && i < node_count, "Node index is out of range.");
+                return *std::launder(nodes + i);
+            }
+
+            // Returns the memory block holding the nodes if they were moved to a separate allocation by `ReplaceNodes()`, or null otherwise.
+            [[nodiscard]] char *SeparateNodeStorage() const
+            {
+                char *ret = reinterpret_cast<char *>(nodes);
+                return ret == InlineNodeStorage() ? nullptr : ret;
+            }
+
+            // Constructs `new_node_count` nodes in `storage`, which must have room for them, then destroys the old nodes.
+            // `func` is the same as in the constructor, but it can also return the old nodes of this entity,
+            //   then the new nodes take their places in the lists.
+            // The caller is responsible for freeing the old storage, see `SeparateNodeStorage()`.
+            template <typename F>
+            void ReplaceNodes(char *storage, int new_node_count, F &&func)
+                requires(noexcept(func(int{})))
+            {
+                ListNode *new_nodes = reinterpret_cast<ListNode *>(storage);
+                for (int i = 0; i < new_node_count; i++)
+                    ::new(new_nodes + i) ListNode(ListNode::insert_before{}, func(i), this);
+                for (int i = 0; i < node_count; i++)
+                    GetNode(i).~ListNode();
+                nodes = new_nodes;
+                node_count = new_node_count;
+            }
+        };
+    }
+
+    namespace impl
+    {
+        // A range returned by `ChunkedStorage::Query()`.
+        // Walks the chunks of all archetypes that belong to a list and have all of `C...`.
+        // The column pointers are computed once per chunk.
+        template <ValidRequestedComponent ...C>
+        class ChunkedQuery
+        {
+            using archetype_list_t = std::vector<std::unique_ptr<Archetype>>;
+
+            const archetype_list_t &archetypes;
+            std::size_t list_index = 0;
+
+            struct State
+            {
+                const archetype_list_t *archetypes = nullptr;
+                std::size_t list_index = 0;
+
+                // The current position. `archetype_index == archetypes->size()` means the end.
+                std::size_t archetype_index = 0;
+                std::size_t chunk_index = 0;
+                std::uint32_t slot = 0;
+
+                // Column indices for the current archetype.
+                std::array<std::size_t, sizeof...(C)> columns{};
+                // Column pointers for the current chunk.
+                ChunkHeader *chunk = nullptr;
+                std::tuple<C *...> bases{};
+
+                // Advances to the first matching archetype, starting from the current one. Resets the chunk and slot indices.
+                void FindArchetype()
+                {
+                    chunk_index = 0;
+                    slot = 0;
+
+                    for (; archetype_index < archetypes->size(); archetype_index++)
+                    {
+                        const Archetype &archetype = *(*archetypes)[archetype_index];
+                        if (!archetype.IsInList(list_index))
+                            continue;
+
+                        columns = {archetype.FindColumn(ComponentId<std::remove_const_t<C>>())...};
+                        if (std::find(columns.begin(), columns.end(), std::size_t(-1)) == columns.end())
+                            return;
+                    }
+                }
+
+                // Advances to the first live entity, starting from the current position.
+                void FindEntity()
+                {
+                    while (archetype_index < archetypes->size())
+                    {
+                        const Archetype &archetype = *(*archetypes)[archetype_index];
+                        for (; chunk_index < archetype.Chunks().size(); chunk_index++, slot = 0)
+                        {
+                            ChunkHeader *this_chunk = archetype.Chunks()[chunk_index];
+                            const std::uint64_t *mask = this_chunk->AliveMask(archetype.ColumnCount());
+                            for (; slot < this_chunk->used; slot++)
+                            {
+                                if (mask[slot / 64] & (std::uint64_t(1) << (slot % 64)))
+                                {
+                                    if (this_chunk != chunk)
+                                    {
+                                        chunk = this_chunk;
+                                        [&]<std::size_t ...I>(std::index_sequence<I...>)
+                                        {
+                                            bases = {reinterpret_cast<C *>(chunk->ElementStorage(columns[I], 0, 0))...};
+                                        }(std::make_index_sequence<sizeof...(C)>{});
+                                    }
+                                    return;
+                                }
+                            }
+                        }
+
+                        archetype_index++;
+                        FindArchetype();
+                    }
+                }
+
+                // Increment.
+                void operator()(std::true_type)
+                {
+                    slot++;
+                    FindEntity();
+                }
+
+                // Dereference.
+                std::tuple<C &...> operator()(std::false_type) const
+                {
+                    return [&]<std::size_t ...I>(std::index_sequence<I...>)
+                    {
+                        return std::tuple<C &...>(MarkChangedIfTracked<C>(*std::launder(std::get<I>(bases) + slot))...);
+                    }(std::make_index_sequence<sizeof...(C)>{});
+                }
+
+                bool operator==(const State &other) const
+                {
+                    return archetype_index == other.archetype_index && chunk_index == other.chunk_index && slot == other.slot;
+                }
+            };
+
+          public:
+            ChunkedQuery(const archetype_list_t &archetypes, std::size_t list_index) : archetypes(archetypes), list_index(list_index) {}
+
+            using iterator_t = SimpleIterator::Input<State>;
+
+            [[nodiscard]] iterator_t begin() const
+            {
+                State state;
+                state.archetypes = &archetypes;
+                state.list_index = list_index;
+                state.FindArchetype();
+                state.FindEntity();
+                return state;
+            }
+            [[nodiscard]] iterator_t end() const
+            {
+                State state;
+                state.archetypes = &archetypes;
+                state.archetype_index = archetypes.size();
+                return state;
+            }
+        };
+    }
+
+    // An entity storage that groups entities by their component sets into fixed-size chunks, with one array per component.
+    // `ChunkSize` is the size of a single chunk in bytes.
+    template <std::size_t ChunkSize = 0x4000>
+    class ChunkedStorage : public BasicEntityStorage
+    {
+        std::vector<std::unique_ptr<impl::Archetype>> archetypes;
+        // Maps `TemplateId<Meta::type_list<C...>>()` to indices in `archetypes`, or -1 if there's no such archetype yet.
+        // This avoids hashing when creating entities.
+        std::vector<std::size_t> archetype_indices;
+
+      public:
+        ChunkedStorage() {}
+
+        ChunkedStorage(ChunkedStorage &&) = default;
+        ChunkedStorage &operator=(ChunkedStorage &&) = default;
+
+        template <Meta::specialization_of<Meta::type_list> L, ValidAllocator A, typename F, typename ...P>
+        Entity &Create(A &allocator, const UntypedEntityTemplate &entity_template, F &&ith_list_head, P &&... params)
+        {
+            static_assert(alignof(impl::ChunkedEntity) <= component_alignment);
+            static_assert(impl::CheckNoExtraComponentInitializers<L, P...>());
+
+            int node_count = entity_template.GetListHandles().size();
+            impl::Archetype &archetype = GetArchetype<L>(entity_template);
+
+            char *storage = allocator.Allocate(impl::ChunkedEntity::RequiredStorageSize(node_count));
+            FINALLY_ON_THROW( allocator.Deallocate(storage); )
+
+            auto [chunk, index] = archetype.ReserveSlot(allocator);
+            ConstructComponents<L>(chunk, index, std::forward<P>(params)...);
+
+            // Nothing below throws, since `ith_list_head` is required to be noexcept.
+            auto *entity = ::new(storage) impl::ChunkedEntity(impl::ChunkedEntity::have_enough_storage{}, chunk, index, node_count, ith_list_head);
+            archetype.CommitSlot(chunk, index, entity);
+            return *entity;
+        }
+
+        // The chunks already hold many entities each, so this simply fills the slots one by one.
+        // The slots are taken from the same chunk while it has free space, so the components of the batch are mostly contiguous.
+        template <Meta::specialization_of<Meta::type_list> L, ValidAllocator A, typename F, typename G>
+        EntityBatch CreateMany(A &allocator, const UntypedEntityTemplate &entity_template, std::size_t count, F &&ith_list_head, G &&initializer)
+        {
+            EntityBatch ret;
+            FINALLY_ON_THROW(
+                for (Entity &entity : ret)
+                    Destroy(allocator, entity);
+            )
+            for (std::size_t i = 0; i < count; i++)
+            {
+                Entity &entity = std::apply([&](auto &&... params) -> Entity &
+                {
+                    return Create<L>(allocator, entity_template, ith_list_head, std::forward<decltype(params)>(params)...);
+                }, initializer(i));
+                FINALLY_ON_THROW( Destroy(allocator, entity); )
+                ret.AddEntity(entity);
+            }
+            return ret;
+        }
+
+        // Moves the components to the archetype of `L`, and replaces the list nodes. The entity object stays in place.
+        template <Meta::specialization_of<Meta::type_list> L, ValidAllocator A, typename F, typename ...P>
+        Entity &Migrate(A &allocator, Entity &entity, const UntypedEntityTemplate &entity_template, F &&ith_list_head, P &&... params)
+        {
+            static_assert(impl::CheckNoExtraComponentInitializers<L, P...>());
+
+            // All entities created by this storage have this type.
+            auto &chunked_entity = static_cast<impl::ChunkedEntity &>(entity);
+            impl::ChunkHeader *old_chunk = chunked_entity.Chunk();
+            std::uint32_t old_index = chunked_entity.Index();
+
+            int node_count = entity_template.GetListHandles().size();
+            impl::Archetype &archetype = GetArchetype<L>(entity_template);
+
+            // The new nodes don't fit after the entity if there are more of them, so they always get a separate allocation.
+            char *node_storage = allocator.Allocate(sizeof(impl::ListNode) * node_count);
+            FINALLY_ON_THROW( allocator.Deallocate(node_storage); )
+
+            // `params...` refer to the old components, which are still alive at this point.
+            auto [chunk, index] = archetype.ReserveSlot(allocator);
+            ConstructComponents<L>(chunk, index, std::forward<P>(params)...);
+
+            // Nothing below throws.
+            archetype.CommitSlot(chunk, index, &chunked_entity);
+            char *old_node_storage = chunked_entity.SeparateNodeStorage();
+            chunked_entity.ReplaceNodes(node_storage, node_count, ith_list_head);
+            chunked_entity.SetSlot(chunk, index);
+
+            old_chunk->archetype->DestroyComponents(old_chunk, old_index);
+            old_chunk->archetype->ReleaseSlot(allocator, old_chunk, old_index);
+            allocator.Deallocate(old_node_storage);
+
+            return entity;
+        }
+
+        template <ValidAllocator A>
+        void Destroy(A &allocator, Entity &entity)
+        {
+            // All entities created by this storage have this type.
+            auto &chunked_entity = static_cast<impl::ChunkedEntity &>(entity);
+            impl::ChunkHeader *chunk = chunked_entity.Chunk();
+            std::uint32_t index = chunked_entity.Index();
+            char *node_storage = chunked_entity.SeparateNodeStorage();
+
+            chunked_entity.~ChunkedEntity();
+            chunk->archetype->DestroyComponents(chunk, index);
+            chunk->archetype->ReleaseSlot(allocator, chunk, index);
+            allocator.Deallocate(node_storage);
+            allocator.Deallocate(reinterpret_cast<char *>(&chunked_entity));
+        }
+
+        template <Meta::specialization_of<Meta::type_list> L>
+        [[nodiscard]] impl::ListNode &GetListNode(Entity &entity, int i) const
+        {
+            return static_cast<impl::ChunkedEntity &>(entity).GetNode(i);
+        }
+
+        template <ValidAllocator A>
+        void ReleaseMemory(A &allocator)
+        {
+            for (auto &archetype : archetypes)
+                archetype->ReleaseMemory(allocator);
+            archetype_indices.clear();
+            archetypes.clear();
+        }
+
+        // Walks over the columns of all archetypes that belong to the list.
+        // Note that `list` itself is not used, we only need its index.
+        template <ValidComponent ...C, typename F>
+        void ForEach(const List &/*list*/, std::size_t list_index, F &&func) const
+        {
+            ForEachMatchingArchetype<C...>(list_index, [&](const impl::Archetype &archetype, const std::array<std::size_t, sizeof...(C)> &columns)
+            {
+                for (impl::ChunkHeader *chunk : archetype.Chunks())
+                    ProcessChunkRange<C...>(archetype, chunk, columns, 0, chunk->used, func);
+            });
+        }
+
+        template <ValidRequestedComponent ...C>
+        [[nodiscard]] impl::ChunkedQuery<C...> Query(const List &/*list*/, std::size_t list_index) const
+        {
+            return {archetypes, list_index};
+        }
+
+        // Splits each chunk into batches of at most `grain_size` slots, and processes them using `pool.ParallelFor()`.
+        template <ValidComponent ...C, typename Pool, typename F>
+        void ParallelForEach(Pool &pool, const List &/*list*/, std::size_t list_index, std::size_t grain_size, F &&func) const
+        {
+            if (grain_size == 0)
+                grain_size = 1;
+
+            struct Batch
+            {
+                const impl::Archetype *archetype = nullptr;
+                impl::ChunkHeader *chunk = nullptr;
+                std::uint32_t begin = 0, end = 0;
+                std::array<std::size_t, sizeof...(C)> columns{};
+            };
+            std::vector<Batch> batches;
+
+            ForEachMatchingArchetype<C...>(list_index, [&](const impl::Archetype &archetype, const std::array<std::size_t, sizeof...(C)> &columns)
+            {
+                for (impl::ChunkHeader *chunk : archetype.Chunks())
+                {
+                    for (std::uint32_t i = 0; i < chunk->used; i += grain_size)
+                        batches.push_back({&archetype, chunk, i, std::uint32_t(std::min<std::size_t>(chunk->used, i + grain_size)), columns});
+                }
+            });
+
+            pool.ParallelFor(0, batches.size(), 1, [&](std::size_t begin, std::size_t end)
+            {
+                for (std::size_t i = begin; i < end; i++)
+                {
+                    const Batch &batch = batches[i];
+                    ProcessChunkRange<C...>(*batch.archetype, batch.chunk, batch.columns, batch.begin, batch.end, func);
+                }
+            });
+        }
+
+      private:
+        // Calls `func(archetype, columns)` for each non-empty archetype that belongs to the list,
+        //   where `columns` are the column indices of `C...`. Throws if some of the archetypes lack the components.
+        template <ValidComponent ...C, typename F>
+        void ForEachMatchingArchetype(std::size_t list_index, F &&func) const
+        {
+            for (const auto &archetype : archetypes)
+            {
+                if (!archetype->IsInList(list_index) || archetype->Chunks().empty())
+                    continue;
+
+                std::array<std::size_t, sizeof...(C)> columns{archetype->FindColumn(ComponentId<C>())...};
+                for (std::size_t column : columns)
+                {
+                    if (column == std::size_t(-1))
+                        Program::Error("Some of the entities in the list lack the requested components.");
+                }
+
+                func(*archetype, columns);
+            }
+        }
+
+        // Calls `func(C &...)` for all live entities in the slots `[begin, end)` of the chunk.
+        template <ValidComponent ...C, typename F>
+        static void ProcessChunkRange(const impl::Archetype &archetype, impl::ChunkHeader *chunk, const std::array<std::size_t, sizeof...(C)> &columns, std::uint32_t begin, std::uint32_t end, F &&func)
+        {
+            const std::uint64_t *mask = chunk->AliveMask(archetype.ColumnCount());
+
+            [&]<std::size_t ...I>(std::index_sequence<I...>)
+            {
+                // Column base pointers.
+                std::tuple<C *...> bases{reinterpret_cast<C *>(chunk->ElementStorage(columns[I], 0, 0))...};
+
+                for (std::uint32_t i = begin; i < end; i++)
+                {
+                    if (mask[i / 64] & (std::uint64_t(1) << (i % 64)))
+                        func(*std::launder(std::get<I>(bases) + i)...);
+                }
+            }(std::make_index_sequence<sizeof...(C)>{});
+        }
+
+        // Constructs the components `L` in a slot of a chunk, forwarding `params...` to them.
+        // If something throws, destroys the already constructed ones.
+        template <Meta::specialization_of<Meta::type_list> L, typename ...P>
+        static void ConstructComponents(impl::ChunkHeader *chunk, std::uint32_t index, P &&... params)
+        {
+            std::size_t constructed = 0;
+            FINALLY_ON_THROW(
+                Meta::cexpr_for<Meta::list_size<L>>([&](auto column)
+                {
+                    using T = Meta::list_type_at<L, column.value>;
+                    if (column.value < constructed)
+                        std::launder(reinterpret_cast<T *>(chunk->ElementStorage(column.value, sizeof(T), index)))->~T();
+                });
+            )
+            Meta::cexpr_for<Meta::list_size<L>>([&](auto column)
+            {
+                using T = Meta::list_type_at<L, column.value>;
+                ::new(chunk->ElementStorage(column.value, sizeof(T), index)) T(impl::GetComponentInitializer<T>(std::forward<P>(params)...));
+                constructed++;
+            });
+        }
+
+        template <Meta::specialization_of<Meta::type_list> L>
+        impl::Archetype &GetArchetype(const UntypedEntityTemplate &entity_template)
+        {
+            std::size_t id = TemplateId<L>();
+            if (id < archetype_indices.size() && archetype_indices[id] != std::size_t(-1))
+                return *archetypes[archetype_indices[id]];
+            if (id >= archetype_indices.size())
+                archetype_indices.resize(id + 1, -1);
+
+            std::vector<std::size_t> list_indices;
+            for (ListHandle handle : entity_template.GetListHandles())
+                list_indices.push_back(handle.GetIndex());
+            std::sort(list_indices.begin(), list_indices.end());
+
+            [&]<typename ...C>(Meta::type_list<C...>)
+            {
+                static_assert(((alignof(C) <= component_alignment) && ...));
+                archetypes.push_back(std::make_unique<impl::Archetype>(
+                    std::vector<std::size_t>{ComponentId<C>()...}, std::vector<std::size_t>{sizeof(C)...},
+                    std::vector<void (*)(void *)>{[](void *component){static_cast<C *>(component)->~C();}...},
+                    std::move(list_indices), ChunkSize
+                ));
+            }(L{});
+            archetype_indices[id] = archetypes.size() - 1;
+            return *archetypes.back();
+        }
+    };
+}
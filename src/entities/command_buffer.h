@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include "entities/base.h"
+#include "macros/finally.h"
+#include "meta/lists.h"
+#include "meta/misc.h"
+
+namespace Ent
+{
+    // Records entity creation and destruction requests, to apply them later in a single batch.
+    // This allows changing the set of entities while iterating over the entity lists:
+    //   record the changes during the iteration, then call `Apply()` after it.
+    // A command buffer isn't bound to a specific controller until `Apply()` is called, and doesn't touch it before that.
+    //   This means that several threads can fill separate buffers concurrently, which can then be merged with `Append()`.
+    // The destroyed entities are recorded as handles, so it's fine if they're destroyed by other means before the buffer is applied.
+    template <Meta::specialization_of<Controller> ControllerType>
+    class CommandBuffer
+    {
+        struct CreateCommand
+        {
+            // Commands with the same key create the same kind of entities.
+            std::type_index key;
+            std::function<void(ControllerType &)> func;
+        };
+
+        std::vector<CreateCommand> create_commands;
+        std::vector<EntityHandle> destroy_commands;
+
+      public:
+        CommandBuffer() {}
+
+        // Checks if the buffer has any commands.
+        [[nodiscard]] bool IsEmpty() const
+        {
+            return create_commands.empty() && destroy_commands.empty();
+        }
+
+        // Records a creation of an entity using a template.
+        // The template must outlive the buffer, or at least stay alive until `Apply()`.
+        // The parameters are copied (or moved) into the buffer, and forwarded to `Controller::Create()` when the buffer is applied.
+        template <ValidComponent ...C, typename ...P>
+        void Create(const EntityTemplate<C...> &entity_template, P &&... params)
+        {
+            create_commands.push_back({typeid(Meta::type_list<C...>), Meta::fake_copyable([&entity_template, ...params = std::forward<P>(params)](ControllerType &controller) mutable
+            {
+                controller.Create(entity_template, std::move(params)...);
+            })});
+        }
+
+        // Records a creation of an entity using a template cache.
+        // The cache must stay alive until `Apply()`.
+        // The parameters are copied (or moved) into the buffer, and forwarded to `Controller::Create()` when the buffer is applied.
+        template <ValidComponent ...C, typename ...P>
+        void Create(ValidEntityTemplateCache auto &template_cache, P &&... params)
+        {
+            create_commands.push_back({typeid(Meta::type_list<C...>), Meta::fake_copyable([&template_cache, ...params = std::forward<P>(params)](ControllerType &controller) mutable
+            {
+                controller.template Create<C...>(template_cache, std::move(params)...);
+            })});
+        }
+
+        // Records a destruction of an entity, given its handle (see `Controller::GetHandle()`).
+        // Destroying the same entity several times is allowed, the duplicates are ignored.
+        // If the entity no longer exists when the buffer is applied, the command is ignored.
+        void Destroy(EntityHandle handle)
+        {
+            destroy_commands.push_back(handle);
+        }
+
+        // Moves all commands from `other` to the end of this buffer.
+        void Append(CommandBuffer &&other)
+        {
+            create_commands.insert(create_commands.end(), std::make_move_iterator(other.create_commands.begin()), std::make_move_iterator(other.create_commands.end()));
+            destroy_commands.insert(destroy_commands.end(), other.destroy_commands.begin(), other.destroy_commands.end());
+            other.Clear();
+        }
+
+        // Discards all commands.
+        void Clear()
+        {
+            create_commands.clear();
+            destroy_commands.clear();
+        }
+
+        // Applies all recorded commands to the controller, then clears the buffer.
+        // The entities are destroyed first (so their memory can be reused), ordered by their addresses to improve memory locality.
+        //   The stale handles are skipped.
+        // Then the entities are created. The creation commands are grouped by the entity type, preserving the order within the groups,
+        //   so the entities of the same type are allocated together.
+        // If a command throws, the remaining commands are discarded.
+        void Apply(ControllerType &controller)
+        {
+            FINALLY( Clear(); )
+
+            // Resolve all handles before destroying anything.
+            std::vector<Entity *> destroyed_entities;
+            destroyed_entities.reserve(destroy_commands.size());
+            for (EntityHandle handle : destroy_commands)
+            {
+                if (Entity *entity = controller.TryGet(handle))
+                    destroyed_entities.push_back(entity);
+            }
+
+            std::sort(destroyed_entities.begin(), destroyed_entities.end(), std::less<>{});
+            destroyed_entities.erase(std::unique(destroyed_entities.begin(), destroyed_entities.end()), destroyed_entities.end());
+            for (Entity *entity : destroyed_entities)
+                controller.Destroy(*entity);
+
+            std::stable_sort(create_commands.begin(), create_commands.end(), [](const CreateCommand &a, const CreateCommand &b){return a.key < b.key;});
+            for (CreateCommand &command : create_commands)
+                command.func(controller);
+        }
+    };
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "entities/base.h"
+#include "entities/snapshot.h"
+#include "meta/misc.h"
+#include "program/errors.h"
+#include "stream/input.h"
+#include "stream/output.h"
+#include "stream/readonly_data.h"
+#include "utils/archive.h"
+
+namespace Ent
+{
+    // Records the state of a controller every tick, to be able to step backwards through the recent ticks (for replays and debugging).
+    // Each tick is saved with `SaveSnapshot()` (see `entities/snapshot.h`). Every `keyframe_interval` ticks, the snapshot is stored as a keyframe,
+    //   compressed with `Archive::Compress()`. The other ticks store a delta against the last keyframe:
+    //   the snapshot is XORed with the keyframe, and the resulting runs of zero bytes are run-length encoded.
+    // Restoring a tick costs one keyframe decompression and one delta decoding, plus walking back at most `keyframe_interval` ticks.
+    // The memory usage is capped: when it exceeds the limit, the oldest keyframes are dropped along with their deltas.
+    //   The most recent keyframe is never dropped, even if it alone exceeds the limit.
+    // All the components of the recorded entities must be registered with `RegisterSnapshotComponent()`.
+    template <Meta::specialization_of<Controller> ControllerType>
+    class RewindBuffer
+    {
+        struct Frame
+        {
+            bool is_keyframe = false;
+            // The size of the snapshot.
+            std::size_t size = 0;
+            // For keyframes, the compressed snapshot. For other ticks, the encoded delta against the preceding keyframe.
+            std::vector<std::uint8_t> data;
+        };
+
+        std::size_t max_bytes = 0;
+        std::size_t keyframe_interval = 1;
+
+        std::deque<Frame> frames;
+        // The tick number of `frames.front()`.
+        std::uint64_t first_tick = 0;
+        // The sum of data sizes of all frames.
+        std::size_t stored_bytes = 0;
+
+        // The uncompressed snapshot of the last keyframe, to compute the deltas against.
+        std::vector<std::uint8_t> last_keyframe;
+        // The amount of ticks recorded after the last keyframe.
+        std::size_t ticks_since_keyframe = 0;
+
+        // A scratch buffer for snapshots.
+        std::vector<std::uint8_t> snapshot;
+
+        static void WriteVarInt(std::vector<std::uint8_t> &output, std::size_t value)
+        {
+            while (value >= 0x80)
+            {
+                output.push_back(std::uint8_t(value | 0x80));
+                value >>= 7;
+            }
+            output.push_back(std::uint8_t(value));
+        }
+
+        [[nodiscard]] static std::size_t ReadVarInt(const std::uint8_t *&cur, const std::uint8_t *end)
+        {
+            std::size_t ret = 0;
+            for (int shift = 0;; shift += 7)
+            {
+                if (cur == end || shift >= int(sizeof(std::size_t) * 8))
+                    Program::Error("Invalid delta in a rewind buffer.");
+                std::uint8_t byte = *cur++;
+                ret |= std::size_t(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                    return ret;
+            }
+        }
+
+        // Returns the i-th byte of `keyframe`, or 0 if it's out of range.
+        [[nodiscard]] static std::uint8_t KeyframeByte(const std::vector<std::uint8_t> &keyframe, std::size_t i)
+        {
+            return i < keyframe.size() ? keyframe[i] : 0;
+        }
+
+        // Encodes `target` as a delta against `keyframe`.
+        // The delta is a sequence of pairs: the amount of unchanged bytes, then the amount of changed bytes followed by them (XORed with the keyframe).
+        [[nodiscard]] static std::vector<std::uint8_t> EncodeDelta(const std::vector<std::uint8_t> &keyframe, const std::vector<std::uint8_t> &target)
+        {
+            std::vector<std::uint8_t> ret;
+            std::size_t i = 0;
+            while (i < target.size())
+            {
+                std::size_t unchanged_begin = i;
+                while (i < target.size() && target[i] == KeyframeByte(keyframe, i))
+                    i++;
+                if (i == target.size())
+                    break; // The trailing unchanged bytes are implied by the snapshot size.
+
+                std::size_t changed_begin = i;
+                while (i < target.size() && target[i] != KeyframeByte(keyframe, i))
+                    i++;
+
+                WriteVarInt(ret, changed_begin - unchanged_begin);
+                WriteVarInt(ret, i - changed_begin);
+                for (std::size_t j = changed_begin; j < i; j++)
+                    ret.push_back(target[j] ^ KeyframeByte(keyframe, j));
+            }
+            return ret;
+        }
+
+        // Reverses `EncodeDelta()`.
+        [[nodiscard]] static std::vector<std::uint8_t> DecodeDelta(const std::vector<std::uint8_t> &keyframe, const Frame &frame)
+        {
+            std::vector<std::uint8_t> ret(frame.size);
+            for (std::size_t i = 0; i < ret.size(); i++)
+                ret[i] = KeyframeByte(keyframe, i);
+
+            const std::uint8_t *cur = frame.data.data(), *end = cur + frame.data.size();
+            std::size_t pos = 0;
+            while (cur != end)
+            {
+                pos += ReadVarInt(cur, end);
+                std::size_t changed = ReadVarInt(cur, end);
+                if (changed > ret.size() - std::min(pos, ret.size()) || changed > std::size_t(end - cur))
+                    Program::Error("Invalid delta in a rewind buffer.");
+                for (std::size_t j = 0; j < changed; j++)
+                    ret[pos++] ^= *cur++;
+            }
+            return ret;
+        }
+
+        [[nodiscard]] static std::vector<std::uint8_t> DecompressKeyframe(const Frame &frame)
+        {
+            const std::uint8_t *begin = frame.data.data(), *end = begin + frame.data.size();
+            std::vector<std::uint8_t> ret(Archive::UncompressedSize(begin, end));
+            Archive::Uncompress(begin, end, ret.data());
+            return ret;
+        }
+
+        // Returns the index of the keyframe that the i-th frame depends on.
+        [[nodiscard]] std::size_t KeyframeIndex(std::size_t i) const
+        {
+            while (!frames[i].is_keyframe)
+                i--;
+            return i;
+        }
+
+        // Drops the oldest keyframes with their deltas, until the memory usage fits into the limit.
+        void EnforceMemoryLimit()
+        {
+            while (stored_bytes > max_bytes)
+            {
+                // Find the next keyframe. If there's none, keep the last one.
+                auto next_keyframe = std::find_if(frames.begin() + 1, frames.end(), [](const Frame &frame){return frame.is_keyframe;});
+                if (next_keyframe == frames.end())
+                    break;
+
+                for (auto it = frames.begin(); it != next_keyframe; ++it)
+                    stored_bytes -= it->data.size();
+                first_tick += next_keyframe - frames.begin();
+                frames.erase(frames.begin(), next_keyframe);
+            }
+        }
+
+      public:
+        RewindBuffer() {}
+
+        // `max_bytes` limits the memory used by the recorded ticks (not counting the constant overhead).
+        // A keyframe is recorded every `keyframe_interval` ticks.
+        RewindBuffer(std::size_t max_bytes, std::size_t keyframe_interval = 60)
+            : max_bytes(max_bytes), keyframe_interval(std::max(keyframe_interval, std::size_t(1)))
+        {}
+
+        // Checks if any ticks were recorded.
+        [[nodiscard]] bool IsEmpty() const
+        {
+            return frames.empty();
+        }
+
+        // The range of the recorded ticks, `[FirstTick(), EndTick())`.
+        // The tick numbers keep increasing as the ticks are recorded, even if the old ticks are dropped.
+        [[nodiscard]] std::uint64_t FirstTick() const
+        {
+            return first_tick;
+        }
+        [[nodiscard]] std::uint64_t EndTick() const
+        {
+            return first_tick + frames.size();
+        }
+
+        // Returns the memory used by the recorded ticks, in bytes.
+        [[nodiscard]] std::size_t StoredBytes() const
+        {
+            return stored_bytes;
+        }
+
+        // Forgets all recorded ticks. The next recorded tick will have number `next_tick`.
+        void Clear(std::uint64_t next_tick = 0)
+        {
+            frames.clear();
+            first_tick = next_tick;
+            stored_bytes = 0;
+            last_keyframe.clear();
+            ticks_since_keyframe = 0;
+        }
+
+        // Records the current state of the controller as tick `EndTick()`.
+        void Record(const ControllerType &controller)
+        {
+            snapshot.clear();
+            Stream::Output output = Stream::Output::Container(snapshot);
+            SaveSnapshot(controller, output);
+            output.Flush();
+
+            Frame frame;
+            frame.size = snapshot.size();
+            if (frames.empty() || ticks_since_keyframe + 1 >= keyframe_interval)
+            {
+                frame.is_keyframe = true;
+                frame.data.resize(Archive::MaxCompressedSize(snapshot.data(), snapshot.data() + snapshot.size()));
+                std::uint8_t *end = Archive::Compress(snapshot.data(), snapshot.data() + snapshot.size(), frame.data.data(), frame.data.data() + frame.data.size());
+                frame.data.resize(end - frame.data.data());
+                frame.data.shrink_to_fit();
+
+                std::swap(last_keyframe, snapshot);
+                ticks_since_keyframe = 0;
+            }
+            else
+            {
+                frame.data = EncodeDelta(last_keyframe, snapshot);
+                ticks_since_keyframe++;
+            }
+
+            stored_bytes += frame.data.size();
+            frames.push_back(std::move(frame));
+            EnforceMemoryLimit();
+        }
+
+        // Replaces the entities in the controller with the ones from the specified tick, which must be in `[FirstTick(), EndTick())`.
+        // The controller must be configured in the same way as the recorded one.
+        void Restore(ControllerType &controller, std::uint64_t tick) const
+        {
+            if (tick < FirstTick() || tick >= EndTick())
+                Program::Error("Tick ", tick, " is not in the rewind buffer, which has ticks [", FirstTick(), ",", EndTick(), ").");
+
+            std::size_t index = tick - first_tick;
+            std::size_t keyframe_index = KeyframeIndex(index);
+
+            std::vector<std::uint8_t> keyframe = DecompressKeyframe(frames[keyframe_index]);
+            std::vector<std::uint8_t> data = index == keyframe_index ? std::move(keyframe) : DecodeDelta(keyframe, frames[index]);
+
+            controller.DestroyAllEntities();
+            Stream::Input input(Stream::ReadOnlyData::mem_reference(data));
+            LoadSnapshot(controller, input);
+        }
+
+        // Forgets the ticks after the specified one, so that the recording can continue from it (e.g. after `Restore()`).
+        // `tick` must be in `[FirstTick(), EndTick())`.
+        void DiscardAfter(std::uint64_t tick)
+        {
+            if (tick < FirstTick() || tick >= EndTick())
+                Program::Error("Tick ", tick, " is not in the rewind buffer, which has ticks [", FirstTick(), ",", EndTick(), ").");
+
+            std::size_t new_size = tick - first_tick + 1;
+            while (frames.size() > new_size)
+            {
+                stored_bytes -= frames.back().data.size();
+                frames.pop_back();
+            }
+
+            // The last keyframe could have changed.
+            std::size_t keyframe_index = KeyframeIndex(frames.size() - 1);
+            last_keyframe = DecompressKeyframe(frames[keyframe_index]);
+            ticks_since_keyframe = frames.size() - 1 - keyframe_index;
+        }
+    };
+}
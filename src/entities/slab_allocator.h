@@ -0,0 +1,308 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include "entities/base.h"
+#include "program/errors.h"
+#include "utils/alignment.h"
+
+namespace Ent
+{
+    // An entity allocator that satisfies `ValidAllocator`.
+    // Splits large memory blocks ("slabs") into smaller blocks of several fixed sizes ("size classes"). Each slab holds blocks of a single class.
+    // The slabs are aligned to their size, so `Deallocate()` finds the slab of a block by rounding the pointer down,
+    //   and reads the size class from the slab header. The blocks themselves have no headers.
+    // Each slab has its own free list. Freed blocks are reused in the LIFO order, since they are likely to still be in the cache.
+    // Each size class keeps a list of its slabs that have free blocks. When a slab becomes empty, it's released,
+    //   except for one empty slab per class, which is kept to avoid reallocating it when the usage oscillates.
+    // The largest size class matches the default chunk size of `ChunkedStorage`, so its chunks are allocated from the slabs too.
+    // Larger allocations get their own slab-aligned memory block, with the same header in front of them.
+    // Not thread-safe.
+    template <std::size_t SlabSize = 0x40000>
+    class SlabAllocator
+    {
+      public:
+        // Size classes.
+        static constexpr std::array<std::size_t, 20> size_classes = {16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384};
+
+      private:
+        // The size class index used for large blocks.
+        static constexpr std::uint32_t large_class = -1;
+
+        // A free block. Stored at the beginning of the block.
+        struct FreeBlock
+        {
+            FreeBlock *next = nullptr;
+        };
+
+        // Stored at the beginning of each slab.
+        struct SlabHeader
+        {
+            std::uint32_t class_index = 0;
+            // The amount of allocated blocks in this slab.
+            std::uint32_t live_blocks = 0;
+            // The amount of blocks that were ever carved from this slab. The rest of the slab is untouched.
+            std::uint32_t carved_blocks = 0;
+            // The freed blocks of this slab.
+            FreeBlock *free_list = nullptr;
+            // The neighbors in the list of slabs with free blocks, see `SizeClass::first_free_slab`.
+            SlabHeader *prev = nullptr;
+            SlabHeader *next = nullptr;
+            // Is in the list of slabs with free blocks.
+            bool has_free_blocks = false;
+            // The usable size, only for large blocks.
+            std::size_t large_size = 0;
+        };
+
+        // The offset of the first block in a slab.
+        static constexpr std::size_t header_size = Storage::Align<component_alignment>(sizeof(SlabHeader));
+
+        static_assert(std::all_of(size_classes.begin(), size_classes.end(), [](std::size_t size){return size % component_alignment == 0;}));
+        static_assert(std::is_sorted(size_classes.begin(), size_classes.end()));
+        static_assert(size_classes.front() >= sizeof(FreeBlock));
+        static_assert((SlabSize & (SlabSize - 1)) == 0, "The slab size must be a power of two.");
+        static_assert(SlabSize >= header_size + size_classes.back(), "The slab size is too small.");
+
+        struct SizeClass
+        {
+            // The slabs that have free or uncarved blocks, as a doubly-linked list.
+            SlabHeader *first_free_slab = nullptr;
+            // The amount of slabs with no live blocks. At most one is kept.
+            std::size_t empty_slabs = 0;
+        };
+
+        std::array<SizeClass, size_classes.size()> classes;
+
+        std::size_t bytes_reserved = 0;
+        std::size_t live_blocks = 0;
+        std::size_t bytes_in_use = 0;
+        std::size_t peak_bytes_in_use = 0;
+
+        // Returns the index of the smallest size class that fits `size`, or `large_class` if there is none.
+        [[nodiscard]] static std::uint32_t SizeToClass(std::size_t size)
+        {
+            auto it = std::lower_bound(size_classes.begin(), size_classes.end(), size);
+            if (it == size_classes.end())
+                return large_class;
+            return it - size_classes.begin();
+        }
+
+        // Returns the amount of blocks that fit into a slab of the specified size class.
+        [[nodiscard]] static constexpr std::uint32_t BlocksPerSlab(std::uint32_t class_index)
+        {
+            return (SlabSize - header_size) / size_classes[class_index];
+        }
+
+        [[nodiscard]] static SlabHeader &BlockToSlab(char *block)
+        {
+            return *std::launder(reinterpret_cast<SlabHeader *>(reinterpret_cast<std::uintptr_t>(block) & ~std::uintptr_t(SlabSize - 1)));
+        }
+
+        // Allocates a slab-aligned memory block of the specified size, with a slab header in front of it.
+        [[nodiscard]] SlabHeader &AllocateSlab(std::uint32_t class_index, std::size_t size)
+        {
+            void *memory = operator new(size, std::align_val_t(SlabSize));
+            bytes_reserved += size;
+            SlabHeader &slab = *::new(memory) SlabHeader;
+            slab.class_index = class_index;
+            return slab;
+        }
+
+        void FreeSlab(SlabHeader &slab, std::size_t size) noexcept
+        {
+            bytes_reserved -= size;
+            slab.~SlabHeader();
+            operator delete(&slab, std::align_val_t(SlabSize));
+        }
+
+        static void LinkFreeSlab(SizeClass &cl, SlabHeader &slab) noexcept
+        {
+            slab.has_free_blocks = true;
+            slab.prev = nullptr;
+            slab.next = cl.first_free_slab;
+            if (slab.next)
+                slab.next->prev = &slab;
+            cl.first_free_slab = &slab;
+        }
+
+        static void UnlinkFreeSlab(SizeClass &cl, SlabHeader &slab) noexcept
+        {
+            slab.has_free_blocks = false;
+            (slab.prev ? slab.prev->next : cl.first_free_slab) = slab.next;
+            if (slab.next)
+                slab.next->prev = slab.prev;
+            slab.prev = slab.next = nullptr;
+        }
+
+        // Returns a block of the specified size class.
+        [[nodiscard]] char *AllocateBlock(std::uint32_t class_index)
+        {
+            SizeClass &cl = classes[class_index];
+
+            if (!cl.first_free_slab)
+            {
+                SlabHeader &slab = AllocateSlab(class_index, SlabSize);
+                LinkFreeSlab(cl, slab);
+                cl.empty_slabs++;
+            }
+
+            SlabHeader &slab = *cl.first_free_slab;
+            if (slab.live_blocks == 0)
+                cl.empty_slabs--;
+
+            // Reuse a free block if we have one, otherwise carve a new one.
+            char *ret;
+            if (slab.free_list)
+                ret = reinterpret_cast<char *>(std::exchange(slab.free_list, slab.free_list->next));
+            else
+                ret = reinterpret_cast<char *>(&slab) + header_size + slab.carved_blocks++ * size_classes[class_index];
+            slab.live_blocks++;
+
+            if (!slab.free_list && slab.carved_blocks == BlocksPerSlab(class_index))
+                UnlinkFreeSlab(cl, slab);
+
+            return ret;
+        }
+
+        void DeallocateBlock(SlabHeader &slab, char *block) noexcept
+        {
+            SizeClass &cl = classes[slab.class_index];
+
+            slab.free_list = ::new(block) FreeBlock{slab.free_list};
+            slab.live_blocks--;
+
+            if (!slab.has_free_blocks)
+                LinkFreeSlab(cl, slab);
+
+            if (slab.live_blocks == 0)
+            {
+                if (cl.empty_slabs == 0)
+                {
+                    cl.empty_slabs++;
+                }
+                else
+                {
+                    UnlinkFreeSlab(cl, slab);
+                    FreeSlab(slab, SlabSize);
+                }
+            }
+        }
+
+        // Frees the remaining empty slabs.
+        void FreeEmptySlabs() noexcept
+        {
+            for (SizeClass &cl : classes)
+            {
+                while (cl.first_free_slab)
+                {
+                    SlabHeader &slab = *cl.first_free_slab;
+                    UnlinkFreeSlab(cl, slab);
+                    FreeSlab(slab, SlabSize);
+                }
+                cl.empty_slabs = 0;
+            }
+        }
+
+      public:
+        // Usage statistics.
+        struct Stats
+        {
+            // The amount of memory obtained from `operator new`, including the large blocks.
+            std::size_t bytes_reserved = 0;
+            // The amount of allocated blocks.
+            std::size_t live_blocks = 0;
+            // The amount of memory in the allocated blocks, rounded up to the size classes.
+            std::size_t bytes_in_use = 0;
+            // The max value that `bytes_in_use` had during the lifetime of the allocator.
+            std::size_t peak_bytes_in_use = 0;
+        };
+
+        SlabAllocator() {}
+
+        SlabAllocator(SlabAllocator &&other) noexcept
+            : classes(std::exchange(other.classes, {})),
+            bytes_reserved(std::exchange(other.bytes_reserved, 0)), live_blocks(std::exchange(other.live_blocks, 0)),
+            bytes_in_use(std::exchange(other.bytes_in_use, 0)), peak_bytes_in_use(std::exchange(other.peak_bytes_in_use, 0))
+        {}
+        SlabAllocator &operator=(SlabAllocator other) noexcept
+        {
+            std::swap(classes, other.classes);
+            std::swap(bytes_reserved, other.bytes_reserved);
+            std::swap(live_blocks, other.live_blocks);
+            std::swap(bytes_in_use, other.bytes_in_use);
+            std::swap(peak_bytes_in_use, other.peak_bytes_in_use);
+            return *this;
+        }
+
+        ~SlabAllocator()
+        {
+            ASSERT(live_blocks == 0, "Destroying a slab allocator that still has live blocks.");
+            FreeEmptySlabs();
+        }
+
+        // Throws on failure.
+        // The allocated memory is aligned to `component_alignment`.
+        [[nodiscard]] char *Allocate(std::size_t size)
+        {
+            std::uint32_t class_index = SizeToClass(size);
+
+            char *block;
+            std::size_t usable_size;
+            if (class_index == large_class)
+            {
+                usable_size = Storage::Align<component_alignment>(size);
+                SlabHeader &slab = AllocateSlab(large_class, header_size + usable_size);
+                slab.large_size = usable_size;
+                block = reinterpret_cast<char *>(&slab) + header_size;
+            }
+            else
+            {
+                usable_size = size_classes[class_index];
+                block = AllocateBlock(class_index);
+            }
+
+            live_blocks++;
+            bytes_in_use += usable_size;
+            peak_bytes_in_use = std::max(peak_bytes_in_use, bytes_in_use);
+
+            return block;
+        }
+
+        // Deleting null is a no-op.
+        void Deallocate(char *pointer) noexcept
+        {
+            if (!pointer)
+                return;
+
+            SlabHeader &slab = BlockToSlab(pointer);
+
+            live_blocks--;
+
+            if (slab.class_index == large_class)
+            {
+                bytes_in_use -= slab.large_size;
+                FreeSlab(slab, header_size + slab.large_size);
+                return;
+            }
+
+            bytes_in_use -= size_classes[slab.class_index];
+            DeallocateBlock(slab, pointer);
+        }
+
+        // Returns the usage statistics.
+        [[nodiscard]] Stats GetStats() const
+        {
+            Stats ret;
+            ret.bytes_reserved = bytes_reserved;
+            ret.live_blocks = live_blocks;
+            ret.bytes_in_use = bytes_in_use;
+            ret.peak_bytes_in_use = peak_bytes_in_use;
+            return ret;
+        }
+    };
+}
@@ -0,0 +1,380 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "entities/base.h"
+#include "macros/finally.h"
+#include "meta/misc.h"
+#include "meta/type_info.h"
+#include "program/errors.h"
+#include "reflection/full.h"
+#include "stream/input.h"
+#include "stream/output.h"
+#include "stream/readonly_data.h"
+#include "utils/archive.h"
+
+// Saving all entities of a controller to a binary snapshot, and restoring them.
+// Only the components registered with `RegisterSnapshotComponent()` can be saved. The snapshots identify them by the names given there,
+//   rather than by the type names, so renaming a component type or moving it to a different namespace doesn't break the old snapshots.
+
+namespace Ent
+{
+    namespace impl
+    {
+        // Type-erased functions for saving and loading a component, see `RegisterSnapshotComponent()`.
+        struct SnapshotComponentInfo
+        {
+            std::string name;
+            // Both are null for empty components, which have nothing to save.
+            void (*save)(const void *component, Stream::Output &output) = nullptr;
+            void (*load)(void *component, Stream::Input &input) = nullptr;
+        };
+
+        // The registered components, by `ComponentId()`.
+        [[nodiscard]] inline std::unordered_map<std::size_t, SnapshotComponentInfo> &SnapshotComponentsById()
+        {
+            static std::unordered_map<std::size_t, SnapshotComponentInfo> ret;
+            return ret;
+        }
+        // Maps the names of the registered components to their IDs.
+        [[nodiscard]] inline std::unordered_map<std::string, std::size_t> &SnapshotComponentsByName()
+        {
+            static std::unordered_map<std::string, std::size_t> ret;
+            return ret;
+        }
+
+        // Incremented when the snapshot format changes.
+        inline constexpr std::uint32_t snapshot_version = 2;
+
+        struct SnapshotAccess
+        {
+            template <std::size_t I>
+            [[nodiscard]] static constexpr std::uint32_t &HandleMember(EntityHandle &handle)
+            {
+                if constexpr (I == 0)
+                    return handle.index;
+                else
+                    return handle.generation;
+            }
+
+            [[nodiscard]] static void *GetComponentPtr(Entity &entity, std::size_t component_id)
+            {
+                return const_cast<void *>(entity.GetComponentPtr(component_id));
+            }
+
+            template <typename ControllerType>
+            static void Save(const ControllerType &controller, Stream::Output &output)
+            {
+                // Group the entities by type, in the order of their handle slots.
+                std::vector<std::vector<Entity *>> groups;
+                std::vector<std::size_t> group_types;
+                std::unordered_map<std::size_t, std::size_t> group_indices;
+                for (const auto &slot : controller.handle_slots)
+                {
+                    if (!slot.entity)
+                        continue;
+                    auto [it, is_new] = group_indices.try_emplace(slot.type_index, groups.size());
+                    if (is_new)
+                    {
+                        groups.emplace_back();
+                        group_types.push_back(slot.type_index);
+                    }
+                    groups[it->second].push_back(slot.entity);
+                }
+
+                output.WriteLittle<std::uint32_t>(snapshot_version);
+
+                output.WriteLittle<std::uint32_t>(controller.handle_slots.size());
+                for (const auto &slot : controller.handle_slots)
+                {
+                    output.WriteLittle<std::uint32_t>(slot.generation);
+                    output.WriteLittle<std::uint32_t>(slot.next_free);
+                }
+                output.WriteLittle<std::uint32_t>(controller.first_free_handle_slot.value);
+
+                output.WriteLittle<std::uint32_t>(groups.size());
+                for (std::size_t group_index = 0; group_index < groups.size(); group_index++)
+                {
+                    const std::vector<Entity *> &group = groups[group_index];
+                    const auto &type = ControllerType::EntityTypes()[group_types[group_index]];
+
+                    std::vector<const SnapshotComponentInfo *> components;
+                    for (std::size_t id : type.component_ids)
+                    {
+                        auto it = SnapshotComponentsById().find(id);
+                        if (it == SnapshotComponentsById().end())
+                            Program::Error("Unable to save an entity to a snapshot: some of its components are not registered with `Ent::RegisterSnapshotComponent()`.");
+                        components.push_back(&it->second);
+                    }
+
+                    output.WriteLittle<std::uint32_t>(components.size());
+                    for (const SnapshotComponentInfo *component : components)
+                    {
+                        output.WriteLittle<std::uint32_t>(component->name.size());
+                        output.WriteString(component->name);
+                    }
+
+                    output.WriteLittle<std::uint64_t>(group.size());
+                    for (const Entity *entity : group)
+                        output.WriteLittle<std::uint32_t>(entity->GetHandleSlot());
+
+                    // Each component is written as a contiguous array.
+                    for (std::size_t i = 0; i < components.size(); i++)
+                    {
+                        if (!components[i]->save)
+                            continue;
+                        for (Entity *entity : group)
+                            components[i]->save(GetComponentPtr(*entity, type.component_ids[i]), output);
+                    }
+                }
+            }
+
+            template <typename ControllerType>
+            static void Load(ControllerType &controller, Stream::Input &input)
+            {
+                if (!controller)
+                    Program::Error("Attempt to load a snapshot into a null entity controller.");
+                if (controller.GetEntityCount() != 0)
+                    Program::Error("Attempt to load a snapshot into an entity controller that already has entities.");
+
+                FINALLY_ON_THROW( controller.DestroyAllEntities(); )
+
+                input.WantLocationStyle(Stream::byte_offset);
+
+                // Checks the sizes before allocating memory for them, in case the input is corrupted.
+                // Expects `count` elements of `element_size` bytes each. Divides instead of multiplying, since the count can be arbitrarily large.
+                auto expect_bytes = [&](std::uint64_t count, std::size_t element_size = 1)
+                {
+                    if (count > input.RemainingBytes() / element_size)
+                        Program::Error(input.GetExceptionPrefix() + "Unexpected end of input.");
+                };
+
+                if (std::uint32_t version = input.ReadLittle<std::uint32_t>(); version != snapshot_version)
+                    Program::Error(input.GetExceptionPrefix() + "Unsupported entity snapshot version: " + std::to_string(version) + ".");
+
+                std::uint32_t handle_slot_count = input.ReadLittle<std::uint32_t>();
+                expect_bytes(handle_slot_count, 8);
+                std::vector<typename ControllerType::HandleSlot> new_handle_slots(handle_slot_count);
+                for (auto &slot : new_handle_slots)
+                {
+                    slot.generation = input.ReadLittle<std::uint32_t>();
+                    slot.next_free = input.ReadLittle<std::uint32_t>();
+                }
+                std::uint32_t new_first_free_handle_slot = input.ReadLittle<std::uint32_t>();
+
+                std::uint32_t group_count = input.ReadLittle<std::uint32_t>();
+                for (std::uint32_t i = 0; i < group_count; i++)
+                {
+                    // Map the component names to the IDs, then find the set of components with those IDs.
+                    std::uint32_t component_count = input.ReadLittle<std::uint32_t>();
+                    expect_bytes(component_count, 4);
+                    std::vector<std::size_t> component_ids;
+                    for (std::uint32_t j = 0; j < component_count; j++)
+                    {
+                        std::uint32_t name_size = input.ReadLittle<std::uint32_t>();
+                        expect_bytes(name_size);
+                        std::string name(name_size, '\0');
+                        input.Read(name.data(), name.size());
+
+                        auto it = SnapshotComponentsByName().find(name);
+                        if (it == SnapshotComponentsByName().end())
+                            Program::Error(input.GetExceptionPrefix() + "The entity snapshot uses an unknown component: " + name + ".");
+                        component_ids.push_back(it->second);
+                    }
+
+                    std::vector<std::size_t> sorted_component_ids = component_ids;
+                    std::sort(sorted_component_ids.begin(), sorted_component_ids.end());
+                    std::size_t type = ControllerType::FindEntityType(sorted_component_ids);
+                    if (type == std::size_t(-1))
+                        Program::Error(input.GetExceptionPrefix() + "The entity snapshot uses a set of components that is never created in the program.");
+
+                    std::uint64_t entity_count = input.ReadLittle<std::uint64_t>();
+                    expect_bytes(entity_count, 4);
+                    std::vector<std::uint32_t> slots(entity_count);
+                    for (std::uint32_t &slot : slots)
+                        slot = input.ReadLittle<std::uint32_t>();
+
+                    EntityBatch batch = ControllerType::EntityTypes()[type].create_many(controller, slots.size());
+
+                    for (std::size_t id : component_ids)
+                    {
+                        const SnapshotComponentInfo &component = SnapshotComponentsById().at(id);
+                        if (!component.load)
+                            continue;
+                        for (Entity &entity : batch)
+                            component.load(GetComponentPtr(entity, id), input);
+                    }
+
+                    std::size_t index = 0;
+                    for (Entity &entity : batch)
+                    {
+                        std::uint32_t slot = slots[index++];
+                        if (slot >= new_handle_slots.size() || new_handle_slots[slot].entity)
+                            Program::Error(input.GetExceptionPrefix() + "Invalid handle slot in the entity snapshot.");
+                        new_handle_slots[slot].entity = &entity;
+                        new_handle_slots[slot].type_index = controller.handle_slots[entity.GetHandleSlot()].type_index;
+                    }
+                }
+
+                // Make sure the free slots form a valid list.
+                std::size_t free_slot_count = 0;
+                for (std::uint32_t slot = new_first_free_handle_slot; slot != std::uint32_t(-1); slot = new_handle_slots[slot].next_free)
+                {
+                    if (slot >= new_handle_slots.size() || new_handle_slots[slot].entity || free_slot_count++ > new_handle_slots.size())
+                        Program::Error(input.GetExceptionPrefix() + "Invalid list of free handle slots in the entity snapshot.");
+                }
+
+                // Switch to the saved handle table. The slots used by the loaded entities so far are discarded.
+                controller.handle_slots = std::move(new_handle_slots);
+                controller.first_free_handle_slot.value = new_first_free_handle_slot;
+                for (std::uint32_t i = 0; i < controller.handle_slots.size(); i++)
+                {
+                    if (controller.handle_slots[i].entity)
+                        controller.handle_slots[i].entity->SetHandleSlot(i);
+                }
+            }
+        };
+    }
+
+    // Registers a component, so that the entities having it can be saved to snapshots.
+    // `name` identifies the component in the snapshots. It must be unique, and must not change if the old snapshots should stay loadable.
+    // The component must be default-constructible, and must be reflected unless it's empty.
+    // Call this during static initialization, next to the component: `inline const auto snapshot_foo = Ent::RegisterSnapshotComponent<Foo>("Foo");`.
+    // Returns `ComponentId<T>()`. Throws if the component or the name is already registered.
+    template <ValidComponent T>
+    std::size_t RegisterSnapshotComponent(std::string name)
+    {
+        static_assert(std::default_initializable<T>, "Components saved to snapshots must be default-constructible.");
+        static_assert(std::is_empty_v<T> || requires{Refl::Interface<T>();}, "Non-empty components saved to snapshots must be reflected.");
+
+        impl::SnapshotComponentInfo info;
+        info.name = name;
+        if constexpr (!std::is_empty_v<T>)
+        {
+            info.save = [](const void *component, Stream::Output &output)
+            {
+                Refl::ToBinary(*static_cast<const T *>(component), output);
+            };
+            info.load = [](void *component, Stream::Input &input)
+            {
+                T &object = *static_cast<T *>(component);
+                Refl::Interface(object).FromBinary(object, input, {}, Refl::initial_state);
+            };
+        }
+
+        std::size_t id = ComponentId<T>();
+        if (!impl::SnapshotComponentsByName().try_emplace(name, id).second)
+            Program::Error("Snapshot component name `", name, "` is already registered.");
+        if (!impl::SnapshotComponentsById().try_emplace(id, std::move(info)).second)
+            Program::Error("Component `", Meta::TypeName<T>(), "` is already registered for snapshots.");
+        return id;
+    }
+
+    // Writes all entities of the controller to `output`, along with the handle table. Use `LoadSnapshot()` to restore them.
+    // The entities are grouped by their sets of components, and each component is written as a contiguous array per group.
+    // Throws if some of the components are not registered with `RegisterSnapshotComponent()`.
+    // The order of entities in the lists is not preserved.
+    template <Meta::specialization_of<Controller> ControllerType>
+    void SaveSnapshot(const ControllerType &controller, Stream::Output &output)
+    {
+        impl::SnapshotAccess::Save(controller, output);
+    }
+
+    // Restores the entities saved with `SaveSnapshot()`. The controller must be configured and must have no entities.
+    // Each set of components in the snapshot must be created somewhere in the program (see `Controller::EntityTypes()`).
+    // The handle table is restored too, so the handles stored in the components stay valid,
+    //   but the handles obtained before the call must not be used.
+    // If this throws, the controller is left without entities.
+    template <Meta::specialization_of<Controller> ControllerType>
+    void LoadSnapshot(ControllerType &controller, Stream::Input &input)
+    {
+        impl::SnapshotAccess::Load(controller, input);
+    }
+
+    // Saves a snapshot to a file (see `SaveSnapshot()`), optionally compressing it with `Archive::Compress()`.
+    // Only the serialization happens on the calling thread. The compression and the writing happen on a separate thread,
+    //   to avoid stalling the frame. Call `.get()` on the result to wait for them and to rethrow their errors.
+    template <Meta::specialization_of<Controller> ControllerType>
+    [[nodiscard]] std::future<void> SaveSnapshotToFile(const ControllerType &controller, std::string file_name, bool compress = true)
+    {
+        std::vector<std::uint8_t> data;
+        Stream::Output output = Stream::Output::Container(data);
+        SaveSnapshot(controller, output);
+        output.Flush();
+
+        return std::async(std::launch::async, [file_name = std::move(file_name), data = std::move(data), compress]
+        {
+            Stream::Output file(file_name);
+            file.WriteLittle<std::uint8_t>(compress);
+            if (compress)
+            {
+                std::vector<std::uint8_t> compressed(Archive::MaxCompressedSize(data.data(), data.data() + data.size()));
+                std::uint8_t *end = Archive::Compress(data.data(), data.data() + data.size(), compressed.data(), compressed.data() + compressed.size());
+                file.WriteString(reinterpret_cast<const char *>(compressed.data()), end - compressed.data());
+            }
+            else
+            {
+                file.WriteString(reinterpret_cast<const char *>(data.data()), data.size());
+            }
+            file.Flush();
+        });
+    }
+
+    // Loads a snapshot saved with `SaveSnapshotToFile()`. See `LoadSnapshot()` for details.
+    template <Meta::specialization_of<Controller> ControllerType>
+    void LoadSnapshotFromFile(ControllerType &controller, const std::string &file_name)
+    {
+        Stream::ReadOnlyData file = Stream::ReadOnlyData::file(file_name);
+        if (file.size() < 1)
+            Program::Error("Entity snapshot file `", file_name, "` is empty.");
+
+        const std::uint8_t *begin = file.data() + 1, *end = file.data() + file.size();
+        if (file.data()[0])
+        {
+            Stream::ReadOnlyData uncompressed = Stream::ReadOnlyData::copy_from_function(file_name, Archive::UncompressedSize(begin, end), [&](std::uint8_t *target)
+            {
+                Archive::Uncompress(begin, end, target);
+            });
+            Stream::Input input(std::move(uncompressed));
+            LoadSnapshot(controller, input);
+        }
+        else
+        {
+            Stream::Input input(Stream::ReadOnlyData::mem_reference(begin, end));
+            LoadSnapshot(controller, input);
+        }
+    }
+}
+
+// Makes `Ent::EntityHandle` reflected, so that the components storing handles can be saved to snapshots.
+// This header must be included before such components are serialized.
+namespace Refl::Class::Custom
+{
+    template <> struct name<Ent::EntityHandle>
+    {
+        static constexpr const char *value = "EntityHandle";
+    };
+    template <> struct members<Ent::EntityHandle>
+    {
+        static constexpr std::size_t count = 2;
+        template <std::size_t I> static constexpr auto &at(Ent::EntityHandle &object)
+        {
+            return Ent::impl::SnapshotAccess::HandleMember<I>(object);
+        }
+    };
+    template <> struct member_names<Ent::EntityHandle>
+    {
+        static constexpr bool known = true;
+        static constexpr const char *at(std::size_t index)
+        {
+            return index == 0 ? "index" : "generation";
+        }
+    };
+}
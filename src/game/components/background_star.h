@@ -4,13 +4,15 @@
 
 namespace Components
 {
-    struct BackgroundStar : Ent::Component
+    REFL_STRUCT( BackgroundStar REFL_SILENTLY_EXTENDS Ent::Component )
     {
-        fvec2 pos{};
-        fvec3 color{};
-        float distance = 1;
-
-        float last_move = 0;
+        REFL_MEMBERS
+        (
+            REFL_DECL(fvec2 REFL_INIT{}) pos
+            REFL_DECL(fvec3 REFL_INIT{}) color
+            REFL_DECL(float REFL_INIT = 1) distance
+            REFL_DECL(float REFL_INIT = 0) last_move
+        )
 
 
         void RandomizePos(int m)
@@ -96,6 +98,8 @@ namespace Components
 
         enum class Style {regular, dust};
 
+        BackgroundStar() {}
+
         BackgroundStar(Style style)
         {
             switch (style)
@@ -130,7 +134,7 @@ namespace Components
             }
         }
 
-        void Render()
+        void Render() const
         {
             float extra_len = abs(last_move) - 1;
             if (extra_len <= 0)
@@ -141,4 +145,6 @@ namespace Components
             r.fquad(pos, fvec2(1, 1 + extra_len)).center().color(color).beta(0);
         }
     };
+
+    inline const auto snapshot_background_star = Ent::RegisterSnapshotComponent<BackgroundStar>("BackgroundStar");
 }
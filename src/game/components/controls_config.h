@@ -4,15 +4,21 @@
 
 namespace Components
 {
-    struct ControlsConfig : Ent::Component
+    REFL_STRUCT( ControlsConfig REFL_SILENTLY_EXTENDS Ent::Component )
     {
-        ivec2 pos{};
+        REFL_MEMBERS
+        (
+            REFL_DECL(ivec2 REFL_INIT{}) pos
+        )
 
+        // The buttons are not reflected, so they aren't saved to snapshots. They are the user's settings rather than the game state.
         Input::Button up = Input::up;
         Input::Button down = Input::down;
         Input::Button left = Input::left;
         Input::Button right = Input::right;
     };
 
+    inline const auto snapshot_controls_config = Ent::RegisterSnapshotComponent<ControlsConfig>("ControlsConfig");
+
     inline const auto e_controls_config = EntitiesConfig().AddList(Ent::has_components<ControlsConfig>);
 }
@@ -7,13 +7,20 @@
 
 namespace Components
 {
-    struct Player
-        : Ent::Component
-        , Ent::Implies<Pos>
-        , Ent::ConflictsWith<Vel> // We provide a custom 'velocity' member
+    REFL_STRUCT( Player
+        REFL_SILENTLY_EXTENDS
+            Ent::Component,
+            Ent::Implies<Pos>,
+            Ent::ConflictsWith<Vel> // We provide a custom 'velocity' member
+    )
     {
-        fvec2 vel{};
+        REFL_MEMBERS
+        (
+            REFL_DECL(fvec2 REFL_INIT{}) vel
+        )
     };
 
+    inline const auto snapshot_player = Ent::RegisterSnapshotComponent<Player>("Player");
+
     inline const auto e_player = EntitiesConfig().AddList(Ent::has_components<Components::Player>);
 }
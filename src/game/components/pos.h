@@ -4,10 +4,24 @@
 
 namespace Components
 {
-    struct Pos : Ent::Component
+    REFL_STRUCT( Pos REFL_SILENTLY_EXTENDS Ent::Component )
     {
-        fvec2 pos{};
+        REFL_MEMBERS
+        (
+            REFL_DECL(fvec2 REFL_INIT{}) pos
+        )
 
+        Pos() {}
         Pos(ivec2 pos) : pos(pos) {}
     };
+
+    inline const auto snapshot_pos = Ent::RegisterSnapshotComponent<Pos>("Pos");
+
+    inline const auto e_with_pos = EntitiesConfig().AddList(Ent::has_components<Pos>);
+
+    // A spatial index of all entities with `Pos`, storing their handles.
+    // Updated incrementally at the end of each tick, see `TickActions::_90_PosIndex`. Only the entities that moved, appeared, or disappeared
+    //   since the previous tick are updated. Don't modify it elsewhere, since the update relies on knowing what the index contains.
+    // During a tick the positions can be outdated, and the handles can point to destroyed entities, so use `TryGet()` on them.
+    SpatialHash<Ent::EntityHandle> &PosIndex();
 }
@@ -6,13 +6,18 @@
 
 namespace Components
 {
-    struct Vel : Ent::Component, Ent::Requires<Pos>
+    REFL_STRUCT( Vel REFL_SILENTLY_EXTENDS Ent::Component, Ent::Requires<Pos> )
     {
-        fvec2 vel{};
+        REFL_MEMBERS
+        (
+            REFL_DECL(fvec2 REFL_INIT{}) vel
+        )
 
         Vel() {}
         Vel(ivec2 vel) : vel(vel) {}
     };
 
+    inline const auto snapshot_vel = Ent::RegisterSnapshotComponent<Vel>("Vel");
+
     inline const auto e_with_pos_and_vel = EntitiesConfig().AddList(Ent::has_components<Pos, Vel>);
 }
@@ -1,10 +1,61 @@
 #include "main.h"
 
-Interface::Window window("Iota", screen_size * 2, Interface::windowed, adjust_(Interface::WindowSettings{}, min_size = screen_size));
+// Set `IOTA_PROFILE=<file>` to record the CPU profile (see `utils/profiler.h`). It's written to the file on exit, in the Chrome trace format.
+// This runs before the other globals are initialized, to also profile the asset loading.
+[[maybe_unused]] static const bool profiler_enabled = []{
+    const char *file_name = std::getenv("IOTA_PROFILE");
+    if (!file_name || !*file_name)
+        return false;
+
+    static std::string trace_file_name = file_name;
+    Profiler::SetEnabled(true);
+    Profiler::SetThreadName("Main");
+    std::atexit([]
+    {
+        try
+        {
+            Profiler::ExportChromeTrace(trace_file_name);
+        }
+        catch (std::exception &e)
+        {
+            std::cout << "Unable to save the profile: " << e.what() << '\n';
+        }
+    });
+    return true;
+}();
+
+// Reads an integer from an environment variable, or returns `std::nullopt` if it's not set.
+static std::optional<std::uint64_t> IntegerFromEnv(const char *name)
+{
+    const char *value = std::getenv(name);
+    if (!value || !*value)
+        return std::nullopt;
+    try
+    {
+        return Strings::FromString<std::uint64_t>(value);
+    }
+    catch (std::exception &e)
+    {
+        Program::HardError("Invalid value of `", name, "`: ", e.what());
+    }
+}
+
+// Set `IOTA_HEADLESS=<ticks>` to run the simulation without a window or graphics, as fast as possible, and report the timings.
+// `0` runs it until interrupted. The random seed is then fixed, and can be changed with `IOTA_SEED=<seed>`.
+// Combine with `IOTA_PROFILE` to also record the profile, but note that the headless mode clears it periodically (see `HeadlessBasicState`).
+static const std::optional<std::uint64_t> headless_ticks = IntegerFromEnv("IOTA_HEADLESS");
+
+bool IsHeadless()
+{
+    return bool(headless_ticks);
+}
+
+Interface::Window window = IsHeadless() ? Interface::Window() : Interface::Window("Iota", screen_size * 2, Interface::windowed, adjust_(Interface::WindowSettings{}, min_size = screen_size));
 static Graphics::DummyVertexArray dummy_vao = nullptr;
 
 const Graphics::ShaderConfig shader_config = Graphics::ShaderConfig::Core();
-Interface::ImGuiController gui_controller(Poly::derived<Interface::ImGuiController::GraphicsBackend_Modern>, adjust_(Interface::ImGuiController::Config{}, shader_header = shader_config.common_header));
+Interface::ImGuiController gui_controller = IsHeadless() ? Interface::ImGuiController()
+    : Interface::ImGuiController(Poly::derived<Interface::ImGuiController::GraphicsBackend_Modern>, adjust_(Interface::ImGuiController::Config{}, shader_header = shader_config.common_header));
 
 namespace Fonts
 {
@@ -40,10 +91,10 @@ Graphics::TextureAtlas &TextureAtlas()
     }();
     return ret;
 }
-Graphics::Texture texture_main = Graphics::Texture(nullptr).Wrap(Graphics::clamp).Interpolation(Graphics::nearest).SetData(TextureAtlas().GetImage());
+Graphics::Texture texture_main = IsHeadless() ? Graphics::Texture() : Graphics::Texture(nullptr).Wrap(Graphics::clamp).Interpolation(Graphics::nearest).SetData(TextureAtlas().GetImage());
 
-AdaptiveViewport adaptive_viewport(shader_config, screen_size);
-Render r = adjust_(Render(0x2000, shader_config), SetTexture(texture_main), SetMatrix(adaptive_viewport.GetDetails().MatrixCentered()));
+AdaptiveViewport adaptive_viewport = IsHeadless() ? AdaptiveViewport() : AdaptiveViewport(shader_config, screen_size);
+Render r = IsHeadless() ? Render() : adjust_(Render(0x2000, shader_config), SetTexture(texture_main), SetMatrix(adaptive_viewport.GetDetails().MatrixCentered()));
 
 Input::Mouse mouse;
 
@@ -53,7 +104,7 @@ Ent::ControllerConfig &EntitiesConfig()
     return ret;
 }
 
-Random rng(std::time(nullptr));
+Random rng(IsHeadless() ? IntegerFromEnv("IOTA_SEED").value_or(0) : std::time(nullptr));
 
 
 struct ProgramState : Program::DefaultBasicState
@@ -67,7 +118,9 @@ struct ProgramState : Program::DefaultBasicState
     }
 
     int last_second = -1;
-    int tick_counter = 0, frame_counter = 0;
+    // The ticks are counted on the tick thread, see `PipelineTicks()`.
+    std::atomic<int> tick_counter = 0;
+    int frame_counter = 0;
     Metronome metronome = Metronome(60);
 
     Metronome *GetTickMetronome() override
@@ -80,24 +133,15 @@ struct ProgramState : Program::DefaultBasicState
         return 60 * NeedFpsCap();
     }
 
-    void EndFrame() override
+    bool PipelineTicks() override
     {
-        int cur_second = SDL_GetTicks() / 1000;
-        if (cur_second == last_second)
-            return;
-
-        last_second = cur_second;
-        std::cout << "TPS: " << tick_counter << "\n";
-        std::cout << "FPS: " << frame_counter << "\n\n";
-        tick_counter = 0;
-        frame_counter = 0;
+        return true;
     }
 
-    void Tick() override
+    // Runs while no ticks are running, so it's safe to update the input state here.
+    // Since the events are processed once per frame, the input edges (e.g. `Input::Button::pressed()`) are seen by all ticks of the frame.
+    void BeginFrame() override
     {
-        tick_counter++;
-
-        // window.ProcessEvents();
         window.ProcessEvents({gui_controller.EventHook()});
 
         if (window.Resized())
@@ -109,9 +153,32 @@ struct ProgramState : Program::DefaultBasicState
             Program::Exit();
 
         gui_controller.PreTick();
+    }
+
+    void EndFrame() override
+    {
+        int cur_second = SDL_GetTicks() / 1000;
+        if (cur_second == last_second)
+            return;
+
+        last_second = cur_second;
+        std::cout << "TPS: " << tick_counter.exchange(0) << "\n";
+        std::cout << "FPS: " << frame_counter << "\n\n";
+        frame_counter = 0;
+    }
+
+    // Runs on the tick thread, so it must not touch the window or the graphics.
+    void Tick() override
+    {
+        tick_counter++;
         state_manager.Tick();
     }
 
+    void PrepareRender() override
+    {
+        state_manager.PrepareRender();
+    }
+
     void Render() override
     {
         frame_counter++;
@@ -145,8 +212,39 @@ struct ProgramState : Program::DefaultBasicState
     }
 };
 
+// Runs the simulation without rendering, see `IOTA_HEADLESS` above.
+struct HeadlessProgramState : Program::HeadlessBasicState
+{
+    State::StateManager state_manager;
+
+    std::uint64_t GetTickLimit() override
+    {
+        return *headless_ticks;
+    }
+
+    void Tick() override
+    {
+        state_manager.Tick();
+    }
+
+    void Init()
+    {
+        Profiler::SetThreadName("Main");
+        AllocationTracking::SetEnabled(true);
+        state_manager.NextState().Set("Initial");
+    }
+};
+
 int _main_(int, char **)
 {
+    if (IsHeadless())
+    {
+        HeadlessProgramState program_state;
+        program_state.Init();
+        program_state.RunMainLoop();
+        return 0;
+    }
+
     ProgramState program_state;
     program_state.Init();
     program_state.Resize();
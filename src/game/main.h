@@ -3,6 +3,8 @@
 #include "game/master.hpp"
 
 inline constexpr ivec2 screen_size(480, 270);
+// Whether we're running the simulation without a window or graphics. Then only the ticks run, and the graphics objects below are null.
+[[nodiscard]] bool IsHeadless();
 extern Interface::Window window;
 extern const Graphics::ShaderConfig shader_config;
 extern Interface::ImGuiController gui_controller;
@@ -24,7 +26,7 @@ extern Render r;
 extern Input::Mouse mouse;
 
 extern Ent::ControllerConfig &EntitiesConfig();
-using entity_controller_t = Ent::Controller<>;
+using entity_controller_t = Ent::Controller<Meta::type_list<>, Ent::SlabAllocator<>, Ent::ChunkedStorage<>>;
 
 extern Random<> rng;
 
@@ -42,9 +44,21 @@ namespace Actions
         virtual void tick(entity_controller_t &c, const State::NextStateSelector &next_state) const = 0;
     };
 
+    // The ticks run on a separate thread, in parallel with the rendering (see `Program::DefaultBasicState::PipelineTicks()`).
+    // So the render actions are split in two parts: `prepare()` runs while no ticks are running, and copies what `render()` needs
+    //   into the action object itself, then `render()` draws that copy.
     STRUCT( Render POLYMORPHIC )
     {
         UNNAMED_MEMBERS()
-        virtual void render(const entity_controller_t &c) const = 0;
+        virtual void prepare(const entity_controller_t &c) const = 0;
+        virtual void render() const = 0;
+    };
+
+    // GUI windows. Those run on the main thread, while no ticks are running, since ImGui isn't thread-safe.
+    // They don't run in the headless mode.
+    STRUCT( Gui POLYMORPHIC )
+    {
+        UNNAMED_MEMBERS()
+        virtual void gui(entity_controller_t &c) const = 0;
     };
 }
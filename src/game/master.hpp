@@ -2,18 +2,28 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <deque>
 #include <iostream>
 #include <map>
+#include <optional>
+#include <string>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
 #include "audio/complete.h"
 #include "entities/base.h"
+#include "entities/chunked_storage.h"
+#include "entities/slab_allocator.h"
+#include "entities/snapshot.h"
 #include "gameutils/adaptive_viewport.h"
 #include "gameutils/action_sequence.h"
 #include "gameutils/render.h"
+#include "gameutils/spatial_hash.h"
 #include "gameutils/state.h"
 #include "graphics/complete.h"
 #include "input/complete.h"
@@ -35,10 +45,13 @@
 #include "strings/common.h"
 #include "strings/format.h"
 #include "strings/lexical_cast.h"
+#include "utils/allocation_tracking.h"
 #include "utils/clock.h"
 #include "utils/mat.h"
 #include "utils/metronome.h"
 #include "utils/multiarray.h"
 #include "utils/poly_storage.h"
+#include "utils/profiler.h"
 #include "utils/random.h"
 #include "utils/simple_iterator.h"
+#include "utils/thread_pool.h"
@@ -7,18 +7,36 @@ namespace States
         UNNAMED_MEMBERS()
 
         entity_controller_t c;
+        ThreadPool thread_pool;
 
         Initial()
         {
             EntitiesConfig().ConfigureController(c);
-            for (const auto &ptr : ActionSequence<Actions::Init>{})
+            ActionSequence<Actions::Init>{}.ForEach([&](const auto &ptr)
+            {
                 ptr->init(c);
+            });
         }
 
         void Tick(const State::NextStateSelector &next_state) override
         {
-            for (const auto &ptr : ActionSequence<Actions::Tick>{})
+            ActionSequence<Actions::Tick>{}.Run(thread_pool, [&](const auto &ptr)
+            {
                 ptr->tick(c, next_state);
+            });
+        }
+
+        void PrepareRender() override
+        {
+            ActionSequence<Actions::Gui>{}.ForEach([&](const auto &ptr)
+            {
+                ptr->gui(c);
+            });
+
+            ActionSequence<Actions::Render>{}.ForEach([&](const auto &ptr)
+            {
+                ptr->prepare(c);
+            });
         }
 
         void Render() const override
@@ -28,8 +46,10 @@ namespace States
 
             r.BindShader();
 
-            for (const auto &ptr : ActionSequence<Actions::Render>{})
-                ptr->render(c);
+            ActionSequence<Actions::Render>{}.ForEach([&](const auto &ptr)
+            {
+                ptr->render();
+            });
 
             r.Finish();
         }
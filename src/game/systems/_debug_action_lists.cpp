@@ -1,11 +1,11 @@
 #include "game/main.h"
 
-namespace TickActions
+namespace GuiActions
 {
-    STRUCT( _99_Debug_ShowActionLists EXTENDS Actions::Tick )
+    STRUCT( _99_Debug_ShowActionLists EXTENDS Actions::Gui )
     {
         UNNAMED_MEMBERS()
-        void tick(entity_controller_t &, const State::NextStateSelector &) const override
+        void gui(entity_controller_t &) const override
         {
             bool open = ImGui::Begin("Sequences");
             FINALLY( ImGui::End(); )
@@ -35,6 +35,14 @@ namespace TickActions
                         ImGui::TextUnformatted(Refl::Polymorphic::Name(ptr));
                     }
                 }
+                if (ImGui::CollapsingHeader("Gui"))
+                {
+                    for (const auto &ptr : ActionSequence<Actions::Gui>{})
+                    {
+                        ImGui::Bullet();
+                        ImGui::TextUnformatted(Refl::Polymorphic::Name(ptr));
+                    }
+                }
             }
         }
     };
@@ -0,0 +1,48 @@
+#include "game/main.h"
+
+namespace GuiActions
+{
+    STRUCT( _99_Debug_ShowAllocations EXTENDS Actions::Gui )
+    {
+        UNNAMED_MEMBERS()
+        void gui(entity_controller_t &) const override
+        {
+            bool open = ImGui::Begin("Allocations", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+            FINALLY( ImGui::End(); )
+            if (open)
+            {
+                if (!AllocationTracking::available)
+                {
+                    ImGui::TextUnformatted("Allocation tracking is disabled at compile-time.");
+                    return;
+                }
+
+                bool enabled = AllocationTracking::IsEnabled();
+                if (ImGui::Checkbox("Track allocations", &enabled))
+                    AllocationTracking::SetEnabled(enabled);
+
+                // This avoids allocating, to not affect the numbers it displays.
+                std::array<float, 120> allocations{}, kilobytes{};
+                AllocationTracking::Counters last, peak;
+                std::size_t i = 0;
+                AllocationTracking::FrameHistory(allocations.size(), [&](const AllocationTracking::Counters &frame)
+                {
+                    allocations[i] = frame.allocations;
+                    kilobytes[i] = frame.bytes / 1024.f;
+                    i++;
+                    last = frame;
+                    peak.allocations = std::max(peak.allocations, frame.allocations);
+                    peak.bytes = std::max(peak.bytes, frame.bytes);
+                });
+
+                ImGui::Text("Last frame: %llu allocations, %llu bytes", (unsigned long long)last.allocations, (unsigned long long)last.bytes);
+
+                char overlay[64];
+                std::snprintf(overlay, sizeof overlay, "peak %llu", (unsigned long long)peak.allocations);
+                ImGui::PlotLines("Allocations / frame", allocations.data(), allocations.size(), 0, overlay, 0, FLT_MAX, ImVec2(240, 60));
+                std::snprintf(overlay, sizeof overlay, "peak %.1f", peak.bytes / 1024.f);
+                ImGui::PlotLines("KiB / frame", kilobytes.data(), kilobytes.size(), 0, overlay, 0, FLT_MAX, ImVec2(240, 60));
+            }
+        }
+    };
+}
@@ -1,11 +1,11 @@
 #include "game/main.h"
 
-namespace TickActions
+namespace GuiActions
 {
-    STRUCT( _99_Debug_ShowEntityCount EXTENDS Actions::Tick )
+    STRUCT( _99_Debug_ShowEntityCount EXTENDS Actions::Gui )
     {
         UNNAMED_MEMBERS()
-        void tick(entity_controller_t &c, const State::NextStateSelector &) const override
+        void gui(entity_controller_t &c) const override
         {
             bool open = ImGui::Begin("EntityCount", nullptr, ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_AlwaysAutoResize);
             FINALLY( ImGui::End(); )
@@ -13,24 +13,31 @@ namespace InitActions
         {
             static auto te = c.MakeEntityTemplate<Components::BackgroundStar>();
 
-            for (int i = 0; i < 200; i++)
-                c.Create(te, Components::BackgroundStar(Components::BackgroundStar::Style::regular));
+            c.CreateMany(te, 200, [](std::size_t)
+            {
+                return std::tuple(Components::BackgroundStar(Components::BackgroundStar::Style::regular));
+            });
 
-            for (int i = 0; i < 100; i++)
-                c.Create(te, Components::BackgroundStar(Components::BackgroundStar::Style::dust));
+            c.CreateMany(te, 100, [](std::size_t)
+            {
+                return std::tuple(Components::BackgroundStar(Components::BackgroundStar::Style::dust));
+            });
         }
     };
 }
 
 namespace TickActions
 {
-    STRUCT( _10_Stars EXTENDS Actions::Tick )
+    STRUCT( _10_Stars EXTENDS Actions::Tick ATTR ActionWrites<Components::BackgroundStar, Random<>, Input::Mouse> )
     {
         UNNAMED_MEMBERS()
         void tick(entity_controller_t &c, const State::NextStateSelector &) const override
         {
-            for (Ent::Entity &e : c(e_stars))
-                e.get<Components::BackgroundStar>().Move(mouse.pos_f().y / 1.f);
+            float offset = mouse.pos_f().y / 1.f;
+            c.ForEach<Components::BackgroundStar>(e_stars, [&](Components::BackgroundStar &star)
+            {
+                star.Move(offset);
+            });
         }
     };
 }
@@ -40,10 +47,22 @@ namespace RenderActions
     STRUCT( _10_Stars EXTENDS Actions::Render )
     {
         UNNAMED_MEMBERS()
-        void render(const entity_controller_t &c) const override
+
+        mutable std::vector<Components::BackgroundStar> stars;
+
+        void prepare(const entity_controller_t &c) const override
+        {
+            stars.clear();
+            c.ForEach<const Components::BackgroundStar>(e_stars, [&](const Components::BackgroundStar &star)
+            {
+                stars.push_back(star);
+            });
+        }
+
+        void render() const override
         {
-            for (Ent::Entity &e : c(e_stars))
-                e.get<Components::BackgroundStar>().Render();
+            for (const Components::BackgroundStar &star : stars)
+                star.Render();
         }
     };
 }
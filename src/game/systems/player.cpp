@@ -28,7 +28,7 @@ namespace TickActions
     constexpr float max_speed = 2, acc = 0.4;
     constexpr int min_dist_to_screen_edge = 16;
 
-    STRUCT( _20_Player EXTENDS Actions::Tick )
+    STRUCT( _20_Player EXTENDS Actions::Tick ATTR ActionReads<Components::ControlsConfig>, ActionWrites<Components::Pos, Components::Player> )
     {
         UNNAMED_MEMBERS()
         void tick(entity_controller_t &c, const State::NextStateSelector &) const override
@@ -85,12 +85,20 @@ namespace RenderActions
     STRUCT( _20_Player EXTENDS Actions::Render )
     {
         UNNAMED_MEMBERS()
-        void render(const entity_controller_t &c) const override
+
+        mutable std::optional<fvec2> pos;
+
+        void prepare(const entity_controller_t &c) const override
         {
+            pos.reset();
             for (Ent::Entity &e : c.GetAtMostOne(Components::e_player))
-            {
-                r.fquad(e.get<Components::Pos>().pos, atlas.player_ship).center();
-            }
+                pos = e.get<Components::Pos>().pos;
+        }
+
+        void render() const override
+        {
+            if (pos)
+                r.fquad(*pos, atlas.player_ship).center();
         }
     };
 }
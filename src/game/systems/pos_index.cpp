@@ -0,0 +1,82 @@
+#include "game/main.h"
+
+#include "game/components/pos.h"
+
+namespace
+{
+    // What the index currently contains for each entity handle slot, see `_90_PosIndex`.
+    struct IndexedSlot
+    {
+        Ent::EntityHandle handle; // Null if the slot has no point in the index.
+        fvec2 pos{};
+        std::uint64_t last_seen_tick = 0;
+    };
+
+    std::vector<IndexedSlot> indexed_slots;
+    std::uint64_t index_tick = 0;
+}
+
+SpatialHash<Ent::EntityHandle> &Components::PosIndex()
+{
+    static SpatialHash<Ent::EntityHandle> ret(32);
+    return ret;
+}
+
+namespace TickActions
+{
+    STRUCT( _90_PosIndex EXTENDS Actions::Tick ATTR ActionReads<Components::Pos>, ActionWrites<SpatialHash<Ent::EntityHandle>> )
+    {
+        UNNAMED_MEMBERS()
+        void tick(entity_controller_t &c, const State::NextStateSelector &) const override
+        {
+            using namespace Components;
+
+            SpatialHash<Ent::EntityHandle> &index = PosIndex();
+            index_tick++;
+
+            // Insert the new entities and move the existing ones. Only the entities that changed their cells touch the sorted part of the index.
+            // The state is keyed by the handles rather than remembered in the components, so it stays correct when the entities are
+            //   migrated to a different set of components, or restored from a snapshot.
+            for (const Ent::Entity &e : c(e_with_pos))
+            {
+                Ent::EntityHandle handle = c.GetHandle(e);
+                fvec2 pos = e.get<Pos>().pos;
+
+                if (handle.GetIndex() >= indexed_slots.size())
+                    indexed_slots.resize(handle.GetIndex() + 1);
+                IndexedSlot &slot = indexed_slots[handle.GetIndex()];
+
+                if (slot.handle != handle)
+                {
+                    // The slot was reused by a new entity.
+                    if (slot.handle)
+                        index.Remove(slot.pos, slot.handle);
+                    index.Insert(pos, handle);
+                    slot.handle = handle;
+                    slot.pos = pos;
+                }
+                else if (slot.pos != pos)
+                {
+                    index.Move(slot.pos, pos, handle);
+                    slot.pos = pos;
+                }
+
+                slot.last_seen_tick = index_tick;
+            }
+
+            // Remove the entities that were destroyed or lost `Pos`.
+            for (IndexedSlot &slot : indexed_slots)
+            {
+                if (slot.handle && slot.last_seen_tick != index_tick)
+                {
+                    index.Remove(slot.pos, slot.handle);
+                    slot.handle = {};
+                }
+            }
+
+            // The pending points are scanned by every query, so merge them when there are many of them.
+            if (index.PendingSize() > std::max(std::size_t(64), index.Size() / 16))
+                index.Rebuild();
+        }
+    };
+}
@@ -1,11 +1,45 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <typeindex>
+#include <typeinfo>
 #include <vector>
 
 #include "program/errors.h"
 #include "reflection/full_with_poly.h"
 #include "utils/poly_storage.h"
+#include "utils/profiler.h"
+#include "utils/thread_pool.h"
+
+// A base for `ActionReads` and `ActionWrites`.
+struct ActionAccess : Refl::RuntimeClassAttribute
+{
+    std::vector<std::type_index> types;
+    bool write = false;
+
+    ActionAccess(std::vector<std::type_index> types, bool write) : types(std::move(types)), write(write) {}
+};
+
+// Class attributes for actions, declaring which types (usually entity components, or other shared state) they read and write.
+// Usage: `STRUCT( A EXTENDS Actions::Tick ATTR ActionReads<X, Y>, ActionWrites<Z> )`.
+// `ActionSequence::Run()` uses them to run non-conflicting actions in parallel.
+// An action without those attributes is assumed to access everything, and never runs in parallel with other actions.
+//   Such actions also run on the thread that called `Run()`, so they can use the state that isn't safe to touch from other threads.
+// An action with them must not create or destroy entities, and must not touch any unlisted state that other actions can modify.
+template <typename ...T>
+struct ActionReads : ActionAccess
+{
+    ActionReads() : ActionAccess({typeid(T)...}, false) {}
+};
+template <typename ...T>
+struct ActionWrites : ActionAccess
+{
+    ActionWrites() : ActionAccess({typeid(T)...}, true) {}
+};
 
 template <typename Base>
 requires Refl::Class::explicitly_polymorphic<Base>
@@ -30,6 +64,83 @@ class ActionSequence
         return ret;
     }
 
+    // The dependency graph for `Run()`.
+    struct Graph
+    {
+        // For each action, the indices of the actions that must wait for it to finish.
+        std::vector<std::vector<std::size_t>> dependents;
+        // For each action, the amount of actions it must wait for.
+        std::vector<std::size_t> dependency_count;
+        // For each action, whether it has `ActionReads` or `ActionWrites` attributes. Actions without them run on the calling thread.
+        std::vector<bool> declares_accesses;
+        // Scratch space for `Run()`, reused between calls. For each action, the amount of unfinished actions it waits for.
+        mutable std::unique_ptr<std::atomic<std::size_t>[]> remaining_dependencies;
+    };
+
+    // Checks if an action has `ActionReads` or `ActionWrites` attributes.
+    [[nodiscard]] static bool DeclaresAccesses(const storage_t &action)
+    {
+        const auto &attribs = Refl::Polymorphic::RuntimeClassAttribs(action);
+        return std::any_of(attribs.begin(), attribs.end(), [](const Refl::RuntimeClassAttribute *attrib){return dynamic_cast<const ActionAccess *>(attrib);});
+    }
+
+    // Checks if two actions can't run in parallel, judging by their `ActionReads` and `ActionWrites` attributes.
+    [[nodiscard]] static bool Conflict(const storage_t &a, const storage_t &b)
+    {
+        // If either action doesn't declare its accesses, it conflicts with everything.
+        if (!DeclaresAccesses(a) || !DeclaresAccesses(b))
+            return true;
+
+        const auto &attribs_a = Refl::Polymorphic::RuntimeClassAttribs(a);
+        const auto &attribs_b = Refl::Polymorphic::RuntimeClassAttribs(b);
+
+        for (const Refl::RuntimeClassAttribute *attrib_a : attribs_a)
+        {
+            auto access_a = dynamic_cast<const ActionAccess *>(attrib_a);
+            if (!access_a)
+                continue;
+            for (const Refl::RuntimeClassAttribute *attrib_b : attribs_b)
+            {
+                auto access_b = dynamic_cast<const ActionAccess *>(attrib_b);
+                if (!access_b || (!access_a->write && !access_b->write))
+                    continue;
+                for (std::type_index type : access_a->types)
+                {
+                    if (std::find(access_b->types.begin(), access_b->types.end(), type) != access_b->types.end())
+                        return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    static const Graph &GetGraph()
+    {
+        static const Graph ret = []{
+            const std::vector<storage_t> &list = GetList();
+            Graph ret;
+            ret.dependents.resize(list.size());
+            ret.dependency_count.resize(list.size());
+            ret.remaining_dependencies = std::make_unique<std::atomic<std::size_t>[]>(list.size());
+
+            for (const storage_t &action : list)
+                ret.declares_accesses.push_back(DeclaresAccesses(action));
+
+            // A conflicting pair of actions runs in the alphabetical order.
+            for (std::size_t i = 0; i < list.size(); i++)
+            for (std::size_t j = i + 1; j < list.size(); j++)
+            {
+                if (Conflict(list[i], list[j]))
+                {
+                    ret.dependents[i].push_back(j);
+                    ret.dependency_count[j]++;
+                }
+            }
+            return ret;
+        }();
+        return ret;
+    }
+
   public:
     constexpr ActionSequence() {}
 
@@ -44,4 +155,109 @@ class ActionSequence
     {
         return GetList().end();
     }
+
+    // Calls `func(const Refl::PolyStorage<Base> &)` for each action, one by one in the alphabetical order, on the current thread.
+    // Each action is recorded as a profiler zone named after its class, see `PROFILE_SCOPE()`.
+    template <typename F>
+    void ForEach(F &&func) const
+    {
+        for (const storage_t &action : GetList())
+        {
+            PROFILE_SCOPE(Refl::Polymorphic::Name(action));
+            func(action);
+        }
+    }
+
+    // Calls `func(const Refl::PolyStorage<Base> &)` for each action, using `pool`. Blocks until all of them finish.
+    // Actions that conflict (see `ActionReads` and `ActionWrites`) run one after another in the alphabetical order,
+    //   other actions can run in parallel.
+    // If an action throws, the actions depending on it are skipped, and the first exception is rethrown.
+    // Actions that don't declare their accesses run on the calling thread. Since they conflict with everything, nothing else runs at the same time.
+    // If the pool is in the deterministic mode, simply runs the actions one by one in the alphabetical order.
+    // Must not be called recursively or from several threads at once for the same `Base`, since the scratch state is shared.
+    // Each action is recorded as a profiler zone named after its class, see `PROFILE_SCOPE()`.
+    template <typename F>
+    void Run(ThreadPool &pool, F &&func) const
+    {
+        const std::vector<storage_t> &list = GetList();
+
+        auto run_action = [&](const storage_t &action)
+        {
+            PROFILE_SCOPE(Refl::Polymorphic::Name(action));
+            func(action);
+        };
+
+        if (pool.IsDeterministic())
+        {
+            ForEach(func);
+            return;
+        }
+
+        const Graph &graph = GetGraph();
+
+        std::atomic<std::size_t> *remaining_dependencies = graph.remaining_dependencies.get();
+        for (std::size_t i = 0; i < list.size(); i++)
+            remaining_dependencies[i].store(graph.dependency_count[i], std::memory_order_relaxed);
+
+        ThreadPool::Group group;
+
+        // An action that must run on the calling thread, or `none` if there's no such action yet.
+        // There can be at most one, since such actions conflict with everything. When it's set, the group is about to finish.
+        constexpr std::size_t none = -1;
+        std::atomic<std::size_t> calling_thread_action = none;
+
+        // Schedules an action, either to the pool or to the calling thread.
+        auto schedule = [&](auto &schedule, std::size_t index) -> void
+        {
+            if (!graph.declares_accesses[index])
+            {
+                calling_thread_action.store(index, std::memory_order_release);
+                return;
+            }
+
+            // Runs an action, then schedules the dependents that have no more unfinished dependencies.
+            // Submitting from inside of a task keeps the group unfinished, so `Wait()` can't return early.
+            pool.Submit(group, [&, index]
+            {
+                run_action(list[index]);
+                for (std::size_t dependent : graph.dependents[index])
+                {
+                    if (remaining_dependencies[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                        schedule(schedule, dependent);
+                }
+            });
+        };
+
+        try
+        {
+            for (std::size_t i = 0; i < list.size(); i++)
+            {
+                if (graph.dependency_count[i] == 0)
+                    schedule(schedule, i);
+            }
+
+            while (true)
+            {
+                pool.Wait(group);
+
+                std::size_t index = calling_thread_action.exchange(none, std::memory_order_acquire);
+                if (index == none)
+                    break;
+
+                // Nothing else runs at this point, so this can't race with the tasks.
+                run_action(list[index]);
+                for (std::size_t dependent : graph.dependents[index])
+                {
+                    if (remaining_dependencies[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                        schedule(schedule, dependent);
+                }
+            }
+        }
+        catch (...)
+        {
+            // The submitted tasks reference local variables, so we must wait for them anyway.
+            try {pool.Wait(group);} catch (...) {}
+            throw;
+        }
+    }
 };
@@ -1,9 +1,18 @@
 #include "render.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "graphics/complete.h"
 #include "reflection/structs.h"
+#include "utils/profiler.h"
 
 struct Render::Data
 {
@@ -14,6 +23,17 @@ struct Render::Data
         REFL_DECL(fvec3) factors
     )
 
+    // Same as `Attribs`, for `VertexFormat::packed`.
+    // The shaders see the same types (normalized or converted to floats), so they don't need any changes.
+    REFL_SIMPLE_STRUCT( PackedAttribs
+        REFL_DECL(fvec2) pos
+        REFL_DECL(u8vec4 REFL_ATTR Graphics::Normalized) color
+        REFL_DECL(u16vec2) texcoord
+        REFL_DECL(u8vec3 REFL_ATTR Graphics::Normalized) factors
+    )
+    static_assert(sizeof(PackedAttribs) == 20);
+    static_assert(sizeof(Attribs) == 11 * sizeof(float));
+
     REFL_SIMPLE_STRUCT( Uniforms
         REFL_DECL(Graphics::Uniform<fmat4> REFL_ATTR Graphics::Vert) matrix
         REFL_DECL(Graphics::Uniform<fvec2> REFL_ATTR Graphics::Vert) tex_size
@@ -48,23 +68,251 @@ void main()
     gl_FragColor.a *= v_factors.z;
 })";
 
-    Graphics::SimpleRenderQueue<Attribs, 3> queue; // Note that the queue has to be the first field.
+    VertexFormat format = VertexFormat::full;
+    // Only the queue matching `format` is not null.
+    Graphics::QuadRenderQueue<Attribs> queue;
+    Graphics::QuadRenderQueue<PackedAttribs> packed_queue;
     Uniforms uni;
     Graphics::Shader shader;
 
-    Data(int queue_size, const Graphics::ShaderConfig &config) : queue(queue_size), shader("Main", config, Graphics::ShaderPreferences{}, Meta::tag<Attribs>{}, uni, vertex_source, fragment_source) {}
+    Data(int queue_size, const Graphics::ShaderConfig &config, VertexFormat format)
+        : format(format),
+        queue(format == VertexFormat::full ? decltype(queue)(QueueSize(queue_size)) : decltype(queue)()),
+        packed_queue(format == VertexFormat::packed ? decltype(packed_queue)(QueueSize(queue_size)) : decltype(packed_queue)()),
+        shader(format == VertexFormat::full ? MakeShader<Attribs>(config) : MakeShader<PackedAttribs>(config))
+    {}
+
+    // Converts the size from triangles to quads, so that the queue has the same amount of vertices as a `SimpleRenderQueue` of that size.
+    // Then it fits `triangles` triangles (drawn without indices), or more sprites than before, since they need 4 vertices instead of 6.
+    static int QueueSize(int triangles)
+    {
+        return std::clamp((triangles * 3 + 3) / 4, 1, decltype(queue)::max_size);
+    }
+
+    template <typename A> Graphics::Shader MakeShader(const Graphics::ShaderConfig &config)
+    {
+        return Graphics::Shader("Main", config, Graphics::ShaderPreferences{}, Meta::tag<A>{}, uni, vertex_source, fragment_source);
+    }
+
+    // Converts a value in 0..1 range to a normalized 8-bit integer.
+    static std::uint8_t PackNormalized(float value)
+    {
+        // Adding 0.5 and truncating rounds non-negative numbers, and is much faster than `iround()`.
+        return std::uint8_t(std::clamp(value, 0.f, 1.f) * 255 + 0.5f);
+    }
+
+    static void SetVertex(Attribs &out, fvec2 pos, fvec4 color, fvec2 texcoord, fvec3 factors)
+    {
+        out.pos = pos;
+        out.color = color;
+        out.texcoord = texcoord;
+        out.factors = factors;
+    }
+    static void SetVertex(PackedAttribs &out, fvec2 pos, fvec4 color, fvec2 texcoord, fvec3 factors)
+    {
+        out.pos = pos;
+        for (int i = 0; i < 4; i++)
+            out.color[i] = PackNormalized(color[i]);
+        for (int i = 0; i < 2; i++)
+            out.texcoord[i] = std::uint16_t(std::clamp(texcoord[i], 0.f, float(0xffff)) + 0.5f);
+        for (int i = 0; i < 3; i++)
+            out.factors[i] = PackNormalized(factors[i]);
+    }
+
+    static PackedAttribs Pack(const Attribs &attribs)
+    {
+        PackedAttribs ret;
+        SetVertex(ret, attribs.pos, attribs.color, attribs.texcoord, attribs.factors);
+        return ret;
+    }
+
+    // Writes the 4 vertices of a sprite. `offset_a` and `offset_b` are the offsets of the first two corners from `pos`,
+    //   the other two corners have the opposite offsets. `tex_a` and `tex_b` are the opposite corners of the texture region.
+    template <typename A>
+    static void SetQuadVertices(A *out, fvec2 pos, fvec2 offset_a, fvec2 offset_b, fvec4 color, fvec2 tex_a, fvec2 tex_b, fvec3 factors)
+    {
+        SetVertex(out[0], pos + offset_a, color, tex_a, factors);
+        SetVertex(out[1], pos + offset_b, color, fvec2(tex_b.x, tex_a.y), factors);
+        SetVertex(out[2], pos - offset_a, color, tex_b, factors);
+        SetVertex(out[3], pos - offset_b, color, fvec2(tex_a.x, tex_b.y), factors);
+    }
+
+    #if defined(__SSE2__)
+    // SSE2 versions of the above. They produce exactly the same vertices, since they perform the same floating-point operations.
+    // The wide stores span several members, so they write through a pointer to the whole vertex, at the offsets checked here.
+
+    static_assert(offsetof(Attribs, pos) == 0 && offsetof(Attribs, color) == 8 && offsetof(Attribs, texcoord) == 24 && offsetof(Attribs, factors) == 32);
+    static_assert(offsetof(PackedAttribs, pos) == 0 && offsetof(PackedAttribs, color) == 8 && offsetof(PackedAttribs, texcoord) == 12);
+    // The factors are followed by one byte of padding, which the 4-byte store of the factors overwrites.
+    static_assert(offsetof(PackedAttribs, factors) == 16 && offsetof(PackedAttribs, factors) + 4 == sizeof(PackedAttribs));
+
+    static void SetQuadVertices(Attribs *out, fvec2 pos, fvec2 offset_a, fvec2 offset_b, fvec4 color, fvec2 tex_a, fvec2 tex_b, fvec3 factors)
+    {
+        __m128 center = _mm_setr_ps(pos.x, pos.y, pos.x, pos.y);
+        __m128 offsets = _mm_setr_ps(offset_a.x, offset_a.y, offset_b.x, offset_b.y);
+        __m128 pos_01 = _mm_add_ps(center, offsets); // The positions of the vertices 0 and 1.
+        __m128 pos_23 = _mm_sub_ps(center, offsets); // The positions of the vertices 2 and 3.
+        __m128 color_vec = _mm_setr_ps(color.r, color.g, color.b, color.a);
+        __m128 tex = _mm_setr_ps(tex_a.x, tex_a.y, tex_b.x, tex_b.y);
+        __m128 tex_13 = _mm_shuffle_ps(tex, tex, _MM_SHUFFLE(3, 0, 1, 2)); // The texcoords of the vertices 1 and 3.
+
+        // Each vertex is written as `pos, color.rg`, `color.ba, texcoord`, then `factors`.
+        auto Write = [&](Attribs &vertex, __m128 pos_and_color, __m128 vertex_tex)
+        {
+            float *ptr = reinterpret_cast<float *>(&vertex);
+            _mm_storeu_ps(ptr, pos_and_color);
+            _mm_storeu_ps(ptr + 4, _mm_shuffle_ps(color_vec, vertex_tex, _MM_SHUFFLE(1, 0, 3, 2)));
+            vertex.factors = factors;
+        };
+        Write(out[0], _mm_movelh_ps(pos_01, color_vec), tex);
+        Write(out[1], _mm_shuffle_ps(pos_01, color_vec, _MM_SHUFFLE(1, 0, 3, 2)), tex_13);
+        Write(out[2], _mm_movelh_ps(pos_23, color_vec), _mm_movehl_ps(tex, tex));
+        Write(out[3], _mm_shuffle_ps(pos_23, color_vec, _MM_SHUFFLE(1, 0, 3, 2)), _mm_movehl_ps(tex_13, tex_13));
+    }
+
+    static void SetQuadVertices(PackedAttribs *out, fvec2 pos, fvec2 offset_a, fvec2 offset_b, fvec4 color, fvec2 tex_a, fvec2 tex_b, fvec3 factors)
+    {
+        __m128 center = _mm_setr_ps(pos.x, pos.y, pos.x, pos.y);
+        __m128 offsets = _mm_setr_ps(offset_a.x, offset_a.y, offset_b.x, offset_b.y);
+        __m128 pos_01 = _mm_add_ps(center, offsets);
+        __m128 pos_23 = _mm_sub_ps(center, offsets);
+
+        // The color and the factors are the same for all vertices, so they are packed once. Same math as in `PackNormalized()`.
+        auto Normalize = [](__m128 value)
+        {
+            value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1));
+            return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(255)), _mm_set1_ps(0.5f)));
+        };
+        __m128i color_and_factors = Normalize(_mm_setr_ps(color.r, color.g, color.b, color.a));
+        color_and_factors = _mm_packs_epi32(color_and_factors, Normalize(_mm_setr_ps(factors.x, factors.y, factors.z, 0)));
+        color_and_factors = _mm_packus_epi16(color_and_factors, color_and_factors);
+        std::uint32_t packed_color = _mm_cvtsi128_si32(color_and_factors);
+        std::uint32_t packed_factors = _mm_cvtsi128_si32(_mm_srli_si128(color_and_factors, 4)); // The last byte goes to the padding.
+
+        // Same math as in `SetVertex()`. SSE2 has no unsigned 32 to 16 bit packing, so we shift the values to the signed range and back.
+        __m128 tex = _mm_setr_ps(tex_a.x, tex_a.y, tex_b.x, tex_b.y);
+        tex = _mm_min_ps(_mm_max_ps(tex, _mm_setzero_ps()), _mm_set1_ps(0xffff));
+        __m128i tex_int = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(tex, _mm_set1_ps(0.5f))), _mm_set1_epi32(0x8000));
+        tex_int = _mm_xor_si128(_mm_packs_epi32(tex_int, tex_int), _mm_set1_epi16(-0x8000));
+        // Now the low 64 bits are `tex_a.x, tex_a.y, tex_b.x, tex_b.y`. Rearrange them into the texcoords of the 4 vertices.
+        tex_int = _mm_unpacklo_epi64(_mm_shufflelo_epi16(tex_int, _MM_SHUFFLE(1, 2, 1, 0)), _mm_shufflelo_epi16(tex_int, _MM_SHUFFLE(3, 0, 3, 2)));
+        std::uint32_t packed_tex[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(packed_tex), tex_int);
+
+        auto Write = [&](PackedAttribs &vertex, std::uint32_t vertex_tex)
+        {
+            char *ptr = reinterpret_cast<char *>(&vertex);
+            std::memcpy(ptr + offsetof(PackedAttribs, color), &packed_color, 4);
+            std::memcpy(ptr + offsetof(PackedAttribs, texcoord), &vertex_tex, 4);
+            std::memcpy(ptr + offsetof(PackedAttribs, factors), &packed_factors, 4);
+        };
+        _mm_storel_pi(reinterpret_cast<__m64 *>(&out[0]), pos_01);
+        _mm_storeh_pi(reinterpret_cast<__m64 *>(&out[1]), pos_01);
+        _mm_storel_pi(reinterpret_cast<__m64 *>(&out[2]), pos_23);
+        _mm_storeh_pi(reinterpret_cast<__m64 *>(&out[3]), pos_23);
+        for (int i = 0; i < 4; i++)
+            Write(out[i], packed_tex[i]);
+    }
+    #endif
+
+    template <typename ...P> void Add(const P &... attribs)
+    {
+        if (format == VertexFormat::full)
+            queue.Add(attribs...);
+        else
+            packed_queue.Add(Pack(attribs)...);
+    }
+
+    void Flush()
+    {
+        queue.Flush();
+        packed_queue.Flush();
+    }
+
+    // Writes the vertices of `count` sprites to `out`, 4 per sprite. Produces the same vertices as `Quad_t` would.
+    // The flags are template parameters, so the loops have no branches.
+    // The sprites are processed in groups: first the corner offsets are computed for the whole group, in a loop that the compiler can vectorize,
+    //   and then the vertices are written, using SSE2 if available (see `SetQuadVertices()`).
+    template <bool Textured, bool Rotated, typename A>
+    static void WriteSprites(const Sprite *sprites, int count, A *out)
+    {
+        constexpr int group_size = 8;
+
+        for (int group = 0; group < count; group += group_size)
+        {
+            const Sprite *in = sprites + group;
+            int n = std::min(group_size, count - group);
+
+            // The offsets of the first two corners from the center. The other two corners have the same offsets with the opposite signs.
+            float ax[group_size], ay[group_size], bx[group_size], by[group_size];
+            for (int i = 0; i < n; i++)
+            {
+                float hx = in[i].size.x / 2, hy = in[i].size.y / 2;
+                if constexpr (Rotated)
+                {
+                    // Same as multiplying `(-hx, -hy)` and `(hx, -hy)` by `fmat2::rotate(angle)`.
+                    float c = std::cos(in[i].angle), s = std::sin(in[i].angle);
+                    ax[i] = s * hy - c * hx;
+                    ay[i] = -s * hx - c * hy;
+                    bx[i] = c * hx + s * hy;
+                    by[i] = s * hx - c * hy;
+                }
+                else
+                {
+                    ax[i] = -hx;
+                    ay[i] = -hy;
+                    bx[i] = hx;
+                    by[i] = -hy;
+                }
+            }
+
+            for (int i = 0; i < n; i++, out += 4)
+            {
+                const Sprite &sprite = in[i];
+
+                fvec4 color = sprite.color.to_vec4(Textured ? 0 : sprite.alpha);
+                fvec3 factors = Textured ? fvec3(sprite.mix, sprite.alpha, sprite.beta) : fvec3(0, 0, sprite.beta);
+                fvec2 tex_a = Textured ? sprite.tex_pos : fvec2(0);
+                fvec2 tex_b = Textured ? sprite.tex_pos + sprite.size : fvec2(0);
+
+                SetQuadVertices(out, sprite.pos, fvec2(ax[i], ay[i]), fvec2(bx[i], by[i]), color, tex_a, tex_b, factors);
+            }
+        }
+    }
+
+    template <typename A>
+    static void AddSprites(Graphics::QuadRenderQueue<A> &target, const Sprite *sprites, std::size_t count, SpriteFlags flags)
+    {
+        using func_t = void (*)(const Sprite *, int, A *);
+        // Indexed by the flags.
+        static constexpr func_t funcs[] = {
+            WriteSprites<false, false, A>,
+            WriteSprites<true , false, A>,
+            WriteSprites<false, true , A>,
+            WriteSprites<true , true , A>,
+        };
+        func_t func = funcs[int(flags & (SpriteFlags::textured | SpriteFlags::rotated))];
+
+        while (count > 0)
+        {
+            int n = int(std::min(count, std::size_t(target.Size())));
+            func(sprites, n, target.AddQuads(n));
+            sprites += n;
+            count -= n;
+        }
+    }
 };
 
 void *Render::GetRenderQueuePtr()
 {
-    return &data->queue;
+    return data.get();
 }
 
 Render::Render() {}
 
-Render::Render(int queue_size, const Graphics::ShaderConfig &config)
+Render::Render(int queue_size, const Graphics::ShaderConfig &config, VertexFormat format)
 {
-    data = std::make_unique<Data>(queue_size, config);
+    data = std::make_unique<Data>(queue_size, config, format);
     SetMatrix(fmat4());
     SetColorMatrix(fmat4());
 }
@@ -85,7 +333,27 @@ void Render::BindShader() const
 
 void Render::Finish()
 {
-    data->queue.Flush();
+    PROFILE_SCOPE("Render::Finish");
+    data->Flush();
+}
+
+void Render::fsprites(const Sprite *sprites, std::size_t count, SpriteFlags flags)
+{
+    if (data->format == VertexFormat::full)
+        data->AddSprites(data->queue, sprites, count, flags);
+    else
+        data->AddSprites(data->packed_queue, sprites, count, flags);
+}
+
+std::uint64_t Render::BytesUploaded() const
+{
+    return data->queue.BytesUploaded() + data->packed_queue.BytesUploaded();
+}
+
+void Render::ResetBytesUploaded()
+{
+    data->queue.ResetBytesUploaded();
+    data->packed_queue.ResetBytesUploaded();
 }
 
 void Render::SetTextureUnit(const Graphics::TexUnit &unit)
@@ -201,7 +469,7 @@ Render::Quad_t::~Quad_t()
     out[1].texcoord = {out[2].texcoord.x, out[0].texcoord.y};
     out[3].texcoord = {out[0].texcoord.x, out[2].texcoord.y};
 
-    ((decltype(Render::Data::queue) *)queue)->Add(out[0], out[1], out[2], out[3]);
+    ((Render::Data *)queue)->Add(out[0], out[1], out[2], out[3]);
 }
 
 Render::Triangle_t::~Triangle_t()
@@ -247,7 +515,7 @@ Render::Triangle_t::~Triangle_t()
             it.pos = (data.matrix * it.pos.to_vec3(1)).to_vec2();
     }
 
-    ((decltype(Render::Data::queue) *)queue)->Add(out[0], out[1], out[2]);
+    ((Render::Data *)queue)->Add(out[0], out[1], out[2]);
 }
 
 Render::Text_t::~Text_t()
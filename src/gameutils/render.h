@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <memory>
 #include <utility>
 
@@ -23,8 +26,40 @@ class Render
     void *GetRenderQueuePtr();
 
   public:
+    enum class VertexFormat
+    {
+        full, // 44 bytes per vertex, all attributes are floats.
+        // 20 bytes per vertex. The colors and the factors (alpha, beta, texture-color mix) are stored as 8-bit normalized values,
+        //   and the texture coordinates are rounded to 16-bit integers. Use it if the texture coordinates are whole pixels.
+        packed,
+    };
+
+    // A quad for `fsprites()`.
+    struct Sprite
+    {
+        fvec2 pos; // The center.
+        fvec2 size;
+        fvec2 tex_pos = fvec2(0); // The texture region has the same size as the quad. Only used with `SpriteFlags::textured`.
+        fvec3 color = fvec3(0);
+        float mix = 1; // Only used with `SpriteFlags::textured`. 0 - fill with color, 1 - use texture.
+        float alpha = 1;
+        float beta = 1; // 1 - normal blending, 0 - additive blending
+        float angle = 0; // Only used with `SpriteFlags::rotated`.
+    };
+
+    enum class SpriteFlags
+    {
+        no_flags = 0,
+        textured = 1 << 0,
+        rotated  = 1 << 1,
+    };
+    [[nodiscard]] friend SpriteFlags operator&(SpriteFlags a, SpriteFlags b) {return SpriteFlags(int(a) & int(b));}
+    [[nodiscard]] friend SpriteFlags operator|(SpriteFlags a, SpriteFlags b) {return SpriteFlags(int(a) | int(b));}
+
     Render();
-    Render(int queue_size, const Graphics::ShaderConfig &config);
+    // `queue_size` is measured in triangles: the queue flushes after that many triangles, or after `queue_size * 3 / 4` quads.
+    // It's clamped to the maximum size supported by the queue (16384 quads or 21845 triangles).
+    Render(int queue_size, const Graphics::ShaderConfig &config, VertexFormat format = VertexFormat::full);
 
     Render(Render &&) noexcept;
     Render &operator=(Render &&) noexcept;
@@ -36,6 +71,11 @@ class Render
 
     void Finish();
 
+    // The amount of vertex data uploaded to the GPU since the last `ResetBytesUploaded()`.
+    // Call `ResetBytesUploaded()` once per frame to get the per-frame amount.
+    [[nodiscard]] std::uint64_t BytesUploaded() const;
+    void ResetBytesUploaded();
+
     void SetTextureUnit(const Graphics::TexUnit &unit);
     void SetTextureUnit(Graphics::TexUnit &&) = delete;
 
@@ -54,7 +94,7 @@ class Render
 
         using ref = Quad_t &&;
 
-        void *queue = 0; // Actually the type should be `Graphics::SimpleRenderQueue<Attribs, 3> *`, but we don't include "graphics/simple_render_queue.h" for better compilation times.
+        void *queue = 0; // Actually the type is `Render::Data *`, which forwards the vertices to the queue for the selected vertex format.
 
         struct Data
         {
@@ -273,7 +313,7 @@ class Render
 
         using ref = Triangle_t &&;
 
-        void *queue = 0; // Actually the type should be `Graphics::SimpleRenderQueue<Attribs, 3> *`, but we don't include "graphics/simple_render_queue.h" for better compilation times.
+        void *queue = 0; // Actually the type is `Render::Data *`, which forwards the vertices to the queue for the selected vertex format.
 
         struct Data
         {
@@ -562,6 +602,18 @@ class Render
         return fquad(pos, image);
     }
 
+    // Draws many similar quads, much faster than calling `fquad()` for each of them (e.g. for particles).
+    // `flags` apply to all of them. Equivalent to `fquad(pos, size).center()`, followed by:
+    // * `.color(color).alpha(alpha).beta(beta)` by default.
+    // * `.tex(tex_pos).color(color).mix(mix).alpha(alpha).beta(beta)` with `SpriteFlags::textured`.
+    // * `.rotate(angle)` with `SpriteFlags::rotated`.
+    void fsprites(const Sprite *sprites, std::size_t count, SpriteFlags flags = SpriteFlags::no_flags);
+    template <typename C>
+    void fsprites(const C &sprites, SpriteFlags flags = SpriteFlags::no_flags)
+    {
+        fsprites(std::data(sprites), std::size(sprites), flags);
+    }
+
     Triangle_t ftriangle(fvec2 a, fvec2 b, fvec2 c)
     {
         return Triangle_t(GetRenderQueuePtr(), a, b, c);
@@ -0,0 +1,84 @@
+#include "render_list.h"
+
+#include "graphics/texture.h"
+#include "utils/profiler.h"
+#include "utils/radix_sort.h"
+
+void RenderList::SetRender(int index, Render &render)
+{
+    ASSERT(index >= 0 && index <= 0xff, "Render list shader index is out of range.");
+    if (std::size_t(index) >= renders.size())
+        renders.resize(index + 1);
+    renders[index] = &render;
+}
+
+void RenderList::SetTexture(int index, const Graphics::Texture &texture)
+{
+    ASSERT(index >= 0 && index <= 0xffff, "Render list texture index is out of range.");
+    if (std::size_t(index) >= textures.size())
+        textures.resize(index + 1);
+    textures[index] = &texture;
+}
+
+void RenderList::Flush()
+{
+    PROFILE_SCOPE("RenderList::Flush");
+
+    stats = {};
+    stats.sprites = commands.size();
+    if (commands.empty())
+        return;
+
+    RadixSort::Sort(commands, commands_buffer, [](const Command &command){return command.key;});
+
+    // Lay out the sprites in the drawing order, so that `Render::fsprites()` can consume them directly.
+    sorted_sprites.clear();
+    sorted_sprites.reserve(sprites.size());
+    for (const Command &command : commands)
+        sorted_sprites.push_back(sprites[command.index]);
+
+    // The part of the key that requires changing the state. The layers and the depths don't, so the runs are merged across them.
+    constexpr std::uint64_t state_mask = 0xffffffull << 24;
+
+    Render *render = nullptr;
+    std::uint64_t state = 0;
+
+    std::size_t begin = 0;
+    while (begin < commands.size())
+    {
+        std::uint64_t new_state = commands[begin].key & state_mask;
+        if (!render || new_state != state)
+        {
+            state = new_state;
+            stats.batches++;
+
+            std::size_t shader = (state >> 40) & 0xff, texture = (state >> 24) & 0xffff;
+            if (shader >= renders.size() || !renders[shader])
+                Program::Error("Render list shader ", shader, " is not set.");
+
+            if (renders[shader] != render)
+            {
+                if (render)
+                    render->Finish();
+                render = renders[shader];
+                render->BindShader();
+            }
+
+            if (texture < textures.size() && textures[texture])
+                render->SetTexture(*textures[texture]); // This finishes the previous batch if necessary.
+        }
+
+        // Find the end of the run with the same state and the same flags.
+        std::size_t end = begin + 1;
+        while (end < commands.size() && (commands[end].key & state_mask) == state && commands[end].flags == commands[begin].flags)
+            end++;
+
+        render->fsprites(sorted_sprites.data() + begin, end - begin, commands[begin].flags);
+        begin = end;
+    }
+
+    render->Finish();
+
+    commands.clear();
+    sprites.clear();
+}
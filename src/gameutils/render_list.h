@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gameutils/render.h"
+#include "program/errors.h"
+
+namespace Graphics
+{
+    class Texture;
+}
+
+// Collects sprites submitted in any order, and draws them sorted by a 64-bit key, merging them into as few draw calls as possible.
+// The key consists of (from the most significant part): layer, shader, texture, depth.
+// The shader and the texture are indices into the tables filled by `SetRender()` and `SetTexture()`.
+//   Different shaders are different `Render`s, each with its own matrix and vertex format. A null texture means "don't change the texture".
+// The sprites are drawn in the increasing order of the keys, and the ones with equal keys are drawn in the order they were added.
+// Note that only the layer orders the sprites regardless of their shader and texture. In the same layer the sprites are grouped by shader
+//   and texture first, so put the sprites that must be drawn on top of the others into a higher layer.
+class RenderList
+{
+  public:
+    struct Key
+    {
+        std::uint16_t layer = 0;
+        std::uint8_t shader = 0;
+        std::uint16_t texture = 0;
+        std::uint32_t depth = 0; // Only the lower 24 bits are used.
+
+        [[nodiscard]] std::uint64_t Packed() const
+        {
+            return std::uint64_t(layer) << 48 | std::uint64_t(shader) << 40 | std::uint64_t(texture) << 24 | (depth & 0xffffff);
+        }
+    };
+
+    struct Stats
+    {
+        std::size_t sprites = 0;
+        // The amount of runs of sprites with the same shader and texture. Each run needs one draw call, unless it overflows the render queue.
+        std::size_t batches = 0;
+    };
+
+  private:
+    struct Command
+    {
+        std::uint64_t key = 0;
+        std::uint32_t index = 0; // In `sprites`.
+        Render::SpriteFlags flags = Render::SpriteFlags::no_flags;
+    };
+
+    std::vector<Render *> renders;
+    std::vector<const Graphics::Texture *> textures;
+
+    std::vector<Command> commands, commands_buffer;
+    std::vector<Render::Sprite> sprites, sorted_sprites;
+
+    Stats stats;
+
+  public:
+    RenderList() {}
+
+    // The pointers are stored, so the `Render` and the textures must outlive the list (or be replaced before the next `Flush()`).
+    void SetRender(int index, Render &render);
+    void SetTexture(int index, const Graphics::Texture &texture);
+    void SetTexture(int index, Graphics::Texture &&) = delete;
+
+    void Add(Key key, const Render::Sprite &sprite, Render::SpriteFlags flags = Render::SpriteFlags::no_flags)
+    {
+        ASSERT(key.depth <= 0xffffff, "Render list depth is out of range.");
+        commands.push_back({key.Packed(), std::uint32_t(sprites.size()), flags});
+        sprites.push_back(sprite);
+    }
+
+    // Sorts and draws all sprites, then clears the list.
+    // Leaves the shader of the last used `Render` bound, and changes the textures of the used `Render`s.
+    void Flush();
+
+    // The stats of the last `Flush()`.
+    [[nodiscard]] const Stats &GetStats() const
+    {
+        return stats;
+    }
+};
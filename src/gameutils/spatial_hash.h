@@ -0,0 +1,423 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "program/errors.h"
+#include "utils/mat.h"
+
+/* A uniform grid of square cells, stored as a hash table. Indexes 2D points, each with a value attached to it.
+ *
+ * The points are stored in a single array, sorted by the hash table bucket (using a counting sort in `Rebuild()`),
+ * so a query reads a few contiguous ranges of memory.
+ *
+ * The index can be maintained incrementally: `Insert()` adds a point to a small unsorted "pending" list
+ * (which is scanned linearly by every query), `Remove()` and `Move()` update the sorted part in place when possible.
+ * Call `Rebuild()` to merge the pending points into the sorted part. It's cheap enough to be called once per tick.
+ *
+ * To reindex everything in a batch, call `Clear()`, then `Insert()` each point, then `Rebuild()`.
+ *
+ * The cell size should be comparable to the typical query radius.
+ * `T` must be default-constructible and equality-comparable (it's used to find the points in `Remove()` and `Move()`),
+ *   e.g. an entity pointer.
+ */
+
+template <typename T>
+class SpatialHash
+{
+  public:
+    struct Entry
+    {
+        fvec2 pos;
+        T value;
+    };
+
+  private:
+    struct Point
+    {
+        Entry entry;
+        ivec2 cell;
+    };
+
+    float cell_size = 1;
+    float inv_cell_size = 1;
+
+    // The sorted points. `points[bucket_begin[i] ... bucket_begin[i] + bucket_size[i])` is the `i`-th bucket.
+    // The range `[bucket_begin[i] + bucket_size[i], bucket_begin[i+1])` is unused, it's left by the removed points.
+    std::vector<Point> points;
+    std::vector<std::uint32_t> bucket_begin; // Has one extra element at the end.
+    std::vector<std::uint32_t> bucket_size;
+    std::uint32_t bucket_mask = 0;
+
+    // The points inserted after the last rebuild.
+    std::vector<Point> pending;
+
+    // Buffers reused by `Rebuild()`.
+    std::vector<Point> scratch;
+    std::vector<std::uint32_t> scratch_buckets;
+
+    std::size_t live_count = 0;
+
+    // The bounding box of all cells that contain points, inclusive. Not shrunk when points are removed, but recomputed by `Rebuild()`.
+    ivec2 min_cell = ivec2(std::numeric_limits<int>::max());
+    ivec2 max_cell = ivec2(std::numeric_limits<int>::min());
+
+    [[nodiscard]] ivec2 PosToCell(fvec2 pos) const
+    {
+        return ivec2(floor(pos * inv_cell_size));
+    }
+
+    [[nodiscard]] std::uint32_t CellToBucket(ivec2 cell) const
+    {
+        return ((std::uint32_t(cell.x) * 73856093u) ^ (std::uint32_t(cell.y) * 19349663u)) & bucket_mask;
+    }
+
+    // Returns the first cell of `[first_cell, last_cell]` (inclusive) that's in the bounding box of the contents,
+    // and the size of the intersection, which is zero if it's empty.
+    [[nodiscard]] std::pair<ivec2, ivec2> ClampCellRange(ivec2 first_cell, ivec2 last_cell) const
+    {
+        first_cell = max(first_cell, min_cell);
+        last_cell = min(last_cell, max_cell);
+        if ((last_cell < first_cell).any())
+            return {first_cell, ivec2(0)};
+        return {first_cell, last_cell - first_cell + 1};
+    }
+
+    // Calls `func(const Point &)` for each point in the cell. Checks `points` only, not `pending`.
+    template <typename F>
+    void ForEachPointInCell(ivec2 cell, F &&func) const
+    {
+        if (bucket_size.empty())
+            return;
+        std::uint32_t bucket = CellToBucket(cell);
+        const Point *begin = points.data() + bucket_begin[bucket];
+        const Point *end = begin + bucket_size[bucket];
+        for (const Point *it = begin; it != end; it++)
+        {
+            // Different cells can share a bucket.
+            if (it->cell == cell)
+                func(*it);
+        }
+    }
+
+    // Calls `func(const Point &)` for each point in the cells `[first_cell, last_cell]` (inclusive), including the pending points.
+    // Pending points are not filtered by cell, `func` should check the position itself.
+    template <typename F>
+    void ForEachPointInCells(ivec2 first_cell, ivec2 last_cell, F &&func) const
+    {
+        for (const Point &point : pending)
+            func(point);
+
+        auto [first, count] = ClampCellRange(first_cell, last_cell);
+        if (!count.all())
+            return;
+
+        // If the area covers more cells than there are points, it's faster to check all points.
+        if (std::size_t(count.x) * std::size_t(count.y) > points.size())
+        {
+            for (std::size_t i = 0; i + 1 < bucket_begin.size(); i++)
+            {
+                for (std::uint32_t j = 0; j < bucket_size[i]; j++)
+                {
+                    const Point &point = points[bucket_begin[i] + j];
+                    if ((point.cell >= first_cell).all() && (point.cell <= last_cell).all())
+                        func(point);
+                }
+            }
+            return;
+        }
+
+        for (int y = first.y; y < first.y + count.y; y++)
+        for (int x = first.x; x < first.x + count.x; x++)
+            ForEachPointInCell(ivec2(x, y), func);
+    }
+
+    // Searches for a point in the sorted part, returns a pointer to it or null if not found.
+    [[nodiscard]] Point *FindSorted(ivec2 cell, const T &value)
+    {
+        if (bucket_size.empty())
+            return nullptr;
+        std::uint32_t bucket = CellToBucket(cell);
+        Point *begin = points.data() + bucket_begin[bucket];
+        Point *end = begin + bucket_size[bucket];
+        Point *it = std::find_if(begin, end, [&](const Point &point){return point.cell == cell && point.entry.value == value;});
+        return it == end ? nullptr : it;
+    }
+
+    // Removes a point from the sorted part, by swapping it with the last point in its bucket.
+    void EraseSorted(Point *point)
+    {
+        std::uint32_t bucket = CellToBucket(point->cell);
+        std::uint32_t &size = bucket_size[bucket];
+        Point &last = points[bucket_begin[bucket] + size - 1];
+        if (point != &last)
+            *point = std::move(last);
+        size--;
+    }
+
+  public:
+    SpatialHash() {}
+
+    explicit SpatialHash(float cell_size) : cell_size(cell_size), inv_cell_size(1 / cell_size)
+    {
+        ASSERT(cell_size > 0, "Spatial hash cell size must be positive.");
+    }
+
+    [[nodiscard]] float CellSize() const
+    {
+        return cell_size;
+    }
+
+    // Returns the amount of points, including the pending ones.
+    [[nodiscard]] std::size_t Size() const
+    {
+        return live_count;
+    }
+
+    // Returns the amount of points inserted after the last rebuild.
+    [[nodiscard]] std::size_t PendingSize() const
+    {
+        return pending.size();
+    }
+
+    // Removes all points. Keeps the memory for reuse.
+    void Clear()
+    {
+        points.clear();
+        bucket_begin.clear();
+        bucket_size.clear();
+        bucket_mask = 0;
+        pending.clear();
+        live_count = 0;
+        min_cell = ivec2(std::numeric_limits<int>::max());
+        max_cell = ivec2(std::numeric_limits<int>::min());
+    }
+
+    // Adds a point. It goes to the pending list until the next `Rebuild()`.
+    void Insert(fvec2 pos, T value)
+    {
+        ivec2 cell = PosToCell(pos);
+        pending.push_back({{pos, std::move(value)}, cell});
+        live_count++;
+        min_cell = min(min_cell, cell);
+        max_cell = max(max_cell, cell);
+    }
+
+    // Removes a point. `pos` must be the position it currently has in the index.
+    // Returns false if there is no such point.
+    bool Remove(fvec2 pos, const T &value)
+    {
+        ivec2 cell = PosToCell(pos);
+
+        if (Point *point = FindSorted(cell, value))
+        {
+            EraseSorted(point);
+            live_count--;
+            return true;
+        }
+
+        auto it = std::find_if(pending.begin(), pending.end(), [&](const Point &point){return point.entry.value == value && point.cell == cell;});
+        if (it == pending.end())
+            return false;
+        *it = std::move(pending.back());
+        pending.pop_back();
+        live_count--;
+        return true;
+    }
+
+    // Changes the position of a point. `old_pos` must be the position it currently has in the index.
+    // If the point stays in the same cell, it's updated in place. Otherwise it's moved to the pending list.
+    // Returns false if there is no such point.
+    bool Move(fvec2 old_pos, fvec2 new_pos, const T &value)
+    {
+        ivec2 old_cell = PosToCell(old_pos), new_cell = PosToCell(new_pos);
+
+        Point *point = FindSorted(old_cell, value);
+        if (!point)
+        {
+            auto it = std::find_if(pending.begin(), pending.end(), [&](const Point &point){return point.entry.value == value && point.cell == old_cell;});
+            if (it == pending.end())
+                return false;
+            point = &*it;
+        }
+        else if (new_cell != old_cell)
+        {
+            T moved_value = std::move(point->entry.value);
+            EraseSorted(point);
+            live_count--;
+            Insert(new_pos, std::move(moved_value));
+            return true;
+        }
+
+        point->entry.pos = new_pos;
+        point->cell = new_cell;
+        min_cell = min(min_cell, new_cell);
+        max_cell = max(max_cell, new_cell);
+        return true;
+    }
+
+    // Merges the pending points into the sorted part, using a counting sort.
+    // The amount of buckets is the smallest power of two not less than the amount of points.
+    void Rebuild()
+    {
+        scratch.clear();
+        scratch.reserve(live_count);
+        for (std::size_t i = 0; i + 1 < bucket_begin.size(); i++)
+        {
+            auto begin = points.begin() + bucket_begin[i];
+            scratch.insert(scratch.end(), std::make_move_iterator(begin), std::make_move_iterator(begin + bucket_size[i]));
+        }
+        scratch.insert(scratch.end(), std::make_move_iterator(pending.begin()), std::make_move_iterator(pending.end()));
+        pending.clear();
+
+        std::size_t bucket_count = 16;
+        while (bucket_count < scratch.size())
+            bucket_count *= 2;
+        bucket_mask = bucket_count - 1;
+
+        // Count the points in each bucket, and recompute the bounding box.
+        bucket_size.assign(bucket_count, 0);
+        scratch_buckets.resize(scratch.size());
+        min_cell = ivec2(std::numeric_limits<int>::max());
+        max_cell = ivec2(std::numeric_limits<int>::min());
+        for (std::size_t i = 0; i < scratch.size(); i++)
+        {
+            std::uint32_t bucket = CellToBucket(scratch[i].cell);
+            scratch_buckets[i] = bucket;
+            bucket_size[bucket]++;
+            min_cell = min(min_cell, scratch[i].cell);
+            max_cell = max(max_cell, scratch[i].cell);
+        }
+
+        // Compute the bucket offsets.
+        bucket_begin.resize(bucket_count + 1);
+        bucket_begin[0] = 0;
+        for (std::size_t i = 0; i < bucket_count; i++)
+            bucket_begin[i+1] = bucket_begin[i] + bucket_size[i];
+
+        // Scatter the points, using `bucket_size` as the insertion cursors.
+        std::fill(bucket_size.begin(), bucket_size.end(), 0);
+        points.clear();
+        points.resize(scratch.size()); // Not using `reserve()`, since we write out of order.
+        for (std::size_t i = 0; i < scratch.size(); i++)
+        {
+            std::uint32_t bucket = scratch_buckets[i];
+            points[bucket_begin[bucket] + bucket_size[bucket]++] = std::move(scratch[i]);
+        }
+
+        live_count = points.size();
+    }
+
+    // Calls `func(const Entry &)` for each point in the rectangle `[a, b]` (inclusive).
+    template <typename F>
+    void ForEachInRect(fvec2 a, fvec2 b, F &&func) const
+    {
+        ForEachPointInCells(PosToCell(a), PosToCell(b), [&](const Point &point)
+        {
+            if ((point.entry.pos >= a).all() && (point.entry.pos <= b).all())
+                func(point.entry);
+        });
+    }
+
+    // Calls `func(const Entry &)` for each point at the distance `radius` or less from `center`.
+    template <typename F>
+    void ForEachInRadius(fvec2 center, float radius, F &&func) const
+    {
+        float radius_sqr = radius * radius;
+        ForEachPointInCells(PosToCell(center - radius), PosToCell(center + radius), [&](const Point &point)
+        {
+            if ((point.entry.pos - center).len_sqr() <= radius_sqr)
+                func(point.entry);
+        });
+    }
+
+    // Finds up to `k` points closest to `center`, writes them to `out` sorted by distance (closest first).
+    // `out` is cleared first. Walks the cells in growing square rings around `center`,
+    // and stops when no unvisited cell can contain a closer point.
+    // Only the parts of the rings that intersect the bounding box of the contents are visited, starting from the first ring that touches it.
+    void FindNearest(fvec2 center, std::size_t k, std::vector<Entry> &out) const
+    {
+        out.clear();
+        if (k == 0 || live_count == 0)
+            return;
+
+        // A max-heap of the best candidates by distance.
+        std::vector<std::pair<float, const Entry *>> heap;
+        heap.reserve(k + 1);
+        auto Consider = [&](const Point &point)
+        {
+            float dist_sqr = (point.entry.pos - center).len_sqr();
+            if (heap.size() == k && dist_sqr >= heap.front().first)
+                return;
+            heap.emplace_back(dist_sqr, &point.entry);
+            std::push_heap(heap.begin(), heap.end(), [](const auto &a, const auto &b){return a.first < b.first;});
+            if (heap.size() > k)
+            {
+                std::pop_heap(heap.begin(), heap.end(), [](const auto &a, const auto &b){return a.first < b.first;});
+                heap.pop_back();
+            }
+        };
+
+        for (const Point &point : pending)
+            Consider(point);
+
+        ivec2 center_cell = PosToCell(center);
+
+        if ((min_cell <= max_cell).all())
+        {
+            // The ring distances are computed in 64 bits, since they can overflow `int` when `center` is far from the contents.
+            auto Dist = [](int a, int b){return std::int64_t(a) - std::int64_t(b);};
+            // The first ring that touches the bounding box, and the last one that still intersects it.
+            std::int64_t first_ring = std::max({Dist(min_cell.x, center_cell.x), Dist(center_cell.x, max_cell.x),
+                                                Dist(min_cell.y, center_cell.y), Dist(center_cell.y, max_cell.y), std::int64_t(0)});
+            std::int64_t last_ring = std::max({std::abs(Dist(min_cell.x, center_cell.x)), std::abs(Dist(max_cell.x, center_cell.x)),
+                                               std::abs(Dist(min_cell.y, center_cell.y)), std::abs(Dist(max_cell.y, center_cell.y))});
+
+            for (std::int64_t ring = first_ring; ring <= last_ring; ring++)
+            {
+                // Any point outside of the rings visited so far is at least this far from `center`.
+                // The rings before `first_ring` are empty, so they count as visited.
+                if (heap.size() == k && ring > 0)
+                {
+                    float min_dist = float(ring - 1) * cell_size;
+                    if (heap.front().first <= min_dist * min_dist)
+                        break;
+                }
+
+                // The ring, clamped to the bounding box. Can't overflow, since the ring intersects the box.
+                std::int64_t ring_min_x = center_cell.x - ring, ring_max_x = center_cell.x + ring;
+                std::int64_t ring_min_y = center_cell.y - ring, ring_max_y = center_cell.y + ring;
+                int first_x = int(std::max<std::int64_t>(ring_min_x, min_cell.x)), last_x = int(std::min<std::int64_t>(ring_max_x, max_cell.x));
+                int first_y = int(std::max<std::int64_t>(ring_min_y, min_cell.y)), last_y = int(std::min<std::int64_t>(ring_max_y, max_cell.y));
+
+                for (int y = first_y; y <= last_y; y++)
+                {
+                    if (y == ring_min_y || y == ring_max_y)
+                    {
+                        // The top or bottom side of the ring.
+                        for (int x = first_x; x <= last_x; x++)
+                            ForEachPointInCell(ivec2(x, y), Consider);
+                    }
+                    else
+                    {
+                        // The left and right sides.
+                        if (ring_min_x >= min_cell.x)
+                            ForEachPointInCell(ivec2(int(ring_min_x), y), Consider);
+                        if (ring_max_x <= max_cell.x)
+                            ForEachPointInCell(ivec2(int(ring_max_x), y), Consider);
+                    }
+                }
+            }
+        }
+
+        std::sort_heap(heap.begin(), heap.end(), [](const auto &a, const auto &b){return a.first < b.first;});
+        out.reserve(heap.size());
+        for (const auto &[dist_sqr, entry] : heap)
+            out.push_back(*entry);
+    }
+};
@@ -4,6 +4,7 @@
 #include <functional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "reflection/full_with_poly.h"
 
@@ -22,6 +23,9 @@ namespace State
         virtual void Init(const std::string &params) {(void)params;}
 
         virtual void Tick(const NextStateSelector &next_state) = 0;
+        // Is called before `Render()`, while `Tick()` isn't running. If the ticks are pipelined
+        //   (see `Program::DefaultBasicState::PipelineTicks()`), copy the state that `Render()` needs here.
+        virtual void PrepareRender() {}
         virtual void Render() const = 0;
     };
     using Storage = Refl::PolyStorage<BasicState>;
@@ -107,6 +111,12 @@ namespace State
         Storage state;
         NextStateSelector next_state;
 
+        // The state that `Render()` uses. Is updated by `PrepareRender()`.
+        const BasicState *rendered_state = nullptr;
+        // The states replaced by `Tick()` since the last `PrepareRender()`.
+        // If the ticks are pipelined, one of them can still be rendered, so we destroy them in `PrepareRender()`.
+        std::vector<Storage> replaced_states;
+
       public:
         StateManager() {}
 
@@ -125,16 +135,27 @@ namespace State
             // Note that we call this before `state->Tick()`.
             // This way, we'll never reach `Render()` with a state that wasn't `Tick`ed yet.
             if (next_state.IsSet())
+            {
+                replaced_states.push_back(std::move(state));
                 state = next_state.ConstructStateAndReset();
+            }
 
             if (state)
                 state->Tick(next_state);
         }
 
-        void Render()
+        void PrepareRender()
         {
+            rendered_state = state ? state.operator->() : nullptr;
+            replaced_states.clear();
             if (state)
-                state->Render();
+                state->PrepareRender();
+        }
+
+        void Render()
+        {
+            if (rendered_state)
+                rendered_state->Render();
         }
     };
 }
@@ -10,6 +10,7 @@
 #include "graphics/geometry.h"
 #include "graphics/image.h"
 #include "graphics/index_buffer.h"
+#include "graphics/quad_render_queue.h"
 #include "graphics/renderer_flat.h"
 #include "graphics/scissor.h"
 #include "graphics/shader.h"
@@ -16,6 +16,7 @@
 #include "strings/format.h"
 #include "utils/mat.h"
 #include "utils/packing.h"
+#include "utils/profiler.h"
 #include "utils/unicode_ranges.h"
 #include "utils/unicode.h"
 
@@ -49,6 +50,8 @@ namespace Graphics
 
         FontFile(Stream::ReadOnlyData file, ivec2 size, int index = 0)
         {
+            PROFILE_SCOPE("FontFile::FontFile (load)");
+
             if (!ft_initialized)
             {
                 ft_initialized = !FT_Init_FreeType(&ft_context);
@@ -326,6 +329,8 @@ namespace Graphics
 
     inline void MakeFontAtlas(Image &image, ivec2 pos, ivec2 size, const std::vector<FontAtlasEntry> &entries, bool add_gaps = 1) // Throws on failure.
     {
+        PROFILE_SCOPE("MakeFontAtlas");
+
         if (!image.RectInBounds(pos, size))
             Program::Error("Invalid target rectangle for a font atlas.");
 
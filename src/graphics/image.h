@@ -7,6 +7,7 @@
 #include "program/errors.h"
 #include "macros/finally.h"
 #include "utils/mat.h"
+#include "utils/profiler.h"
 #include "stream/readonly_data.h"
 
 #include <stb_image.h>
@@ -39,6 +40,7 @@ namespace Graphics
         }
         Image(Stream::ReadOnlyData file, FlipMode flip_mode = no_flip) // Throws on failure.
         {
+            PROFILE_SCOPE("Image::Image (load)");
             stbi_set_flip_vertically_on_load(flip_mode == flip_y);
             ivec2 img_size;
             uint8_t *bytes = stbi_load_from_memory(file.data(), file.size(), &img_size.x, &img_size.y, 0, 4);
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "graphics/index_buffer.h"
+#include "graphics/vertex_buffer.h"
+#include "program/errors.h"
+
+namespace Graphics
+{
+    // Like `SimpleRenderQueue<T, 3>`, but stores 4 vertices per quad instead of 6, and draws them with a static index buffer.
+    // This cuts the amount of the uploaded vertex data by a third.
+    // Triangles are accepted too. They use the same storage, but are drawn without indices, 3 vertices per triangle.
+    // Switching between quads and triangles flushes the queue, so the draw order is preserved, but mixing them often costs extra draw calls.
+    template <typename T> class QuadRenderQueue
+    {
+        static_assert(Graphics::VertexBuffer<T>::is_reflected, "The type must be reflected.");
+
+      public:
+        using index_t = std::uint16_t;
+
+        // The maximum size, measured in quads. It's limited by the index type, since some OpenGL versions don't support 32-bit indices.
+        static constexpr int max_size = (1 << 16) / 4;
+
+      private:
+        int pos = 0, size = 0; // These are measured in quads, not vertices.
+        int triangle_pos = 0; // The amount of stored triangles. Only one of `pos` and `triangle_pos` can be non-zero at a time.
+        std::unique_ptr<T[]> storage;
+        Graphics::VertexBuffer<T> buffer;
+        std::shared_ptr<const IndexBuffer<index_t>> indices;
+        std::uint64_t bytes_uploaded = 0;
+
+        // Returns the index buffer for `max_size` quads, shared by all queues.
+        // It's destroyed when the last queue using it is destroyed, so it doesn't outlive the OpenGL context.
+        [[nodiscard]] static std::shared_ptr<const IndexBuffer<index_t>> SharedIndexBuffer()
+        {
+            static std::weak_ptr<const IndexBuffer<index_t>> weak;
+            if (auto ret = weak.lock())
+                return ret;
+
+            // Each quad `abcd` is split into two triangles, `abd` and `dbc`.
+            std::vector<index_t> data;
+            data.reserve(max_size * 6);
+            for (int i = 0; i < max_size; i++)
+            {
+                index_t a = i * 4, b = a + 1, c = a + 2, d = a + 3;
+                data.insert(data.end(), {a, b, d, d, b, c});
+            }
+
+            auto ret = std::make_shared<const IndexBuffer<index_t>>(int(data.size()), data.data());
+            weak = ret;
+            return ret;
+        }
+
+        T *AddLow()
+        {
+            if (pos >= size || triangle_pos > 0)
+                Flush();
+            return storage.get() + 4 * pos++;
+        }
+
+      public:
+        QuadRenderQueue() {}
+        QuadRenderQueue(int size) : size(size), storage(std::make_unique<T[]>(size * 4)), buffer(size * 4, 0, Graphics::stream_draw), indices(SharedIndexBuffer())
+        {
+            if (size > max_size)
+                Program::Error("The quad render queue size ", size, " is larger than the maximum ", max_size, ".");
+        }
+
+        explicit operator bool()
+        {
+            return bool(storage);
+        }
+
+        // The capacity in quads.
+        int Size() const
+        {
+            return size;
+        }
+
+        // The capacity in triangles, when the queue is used for triangles only.
+        int TriangleCapacity() const
+        {
+            return size * 4 / 3;
+        }
+
+        // The amount of bytes uploaded to the vertex buffer since the last `ResetBytesUploaded()`.
+        [[nodiscard]] std::uint64_t BytesUploaded() const
+        {
+            return bytes_uploaded;
+        }
+        void ResetBytesUploaded()
+        {
+            bytes_uploaded = 0;
+        }
+
+        void Flush()
+        {
+            if (pos > 0)
+            {
+                buffer.SetDataPart(0, pos * 4, storage.get());
+                bytes_uploaded += std::uint64_t(pos) * 4 * sizeof(T);
+                indices->Draw(buffer, triangles, pos * 6);
+                pos = 0;
+            }
+            else if (triangle_pos > 0)
+            {
+                buffer.SetDataPart(0, triangle_pos * 3, storage.get());
+                bytes_uploaded += std::uint64_t(triangle_pos) * 3 * sizeof(T);
+                buffer.Draw(triangles, triangle_pos * 3);
+                triangle_pos = 0;
+            }
+        }
+
+        // Returns the storage for `count` quads (4 vertices each), flushing the queue first if they don't fit.
+        // `count` can't be larger than `Size()`. Use this to write many quads at once, without copying them.
+        [[nodiscard]] T *AddQuads(int count)
+        {
+            ASSERT(count >= 0 && count <= size, "Attempt to add too many quads to a render queue at once.");
+            if (pos + count > size || triangle_pos > 0)
+                Flush();
+            T *ret = storage.get() + 4 * pos;
+            pos += count;
+            return ret;
+        }
+
+        void Add(const T &a, const T &b, const T &c)
+        {
+            if (pos > 0 || triangle_pos >= TriangleCapacity())
+                Flush();
+            T *ptr = storage.get() + 3 * triangle_pos++;
+            ptr[0] = a;
+            ptr[1] = b;
+            ptr[2] = c;
+        }
+        void Add(const T &a, const T &b, const T &c, const T &d)
+        {
+            T *ptr = AddLow();
+            ptr[0] = a;
+            ptr[1] = b;
+            ptr[2] = c;
+            ptr[3] = d;
+        }
+    };
+}
@@ -0,0 +1,198 @@
+#include "recording_backend.h"
+
+#include <map>
+#include <string_view>
+#include <type_traits>
+
+#include <cglfl_generated/macros_internal.hpp>
+
+#include "macros/finally.h"
+#include "program/errors.h"
+
+namespace Graphics
+{
+    namespace impl
+    {
+        using Kind = RecordingBackend::CommandKind;
+
+        [[nodiscard]] static RecordingBackend &Backend()
+        {
+            return *RecordingBackend::Get();
+        }
+
+        // Guesses the kind of a function from its name. Only used for the functions that don't have custom stubs.
+        [[nodiscard]] static Kind ClassifyFunction(std::string_view name)
+        {
+            auto starts_with = [&](std::string_view prefix) {return name.substr(0, prefix.size()) == prefix;};
+
+            if (starts_with("glUniform"))
+                return Kind::uniform;
+
+            static constexpr std::string_view state_prefixes[] = {
+                "glActiveTexture", "glBind", "glBlend", "glClearColor", "glColorMask", "glCullFace", "glDepth", "glDisable", "glDrawBuffer",
+                "glEnable", "glFrontFace", "glLineWidth", "glPixelStore", "glPointSize", "glPolygonMode", "glScissor", "glStencil",
+                "glTexParameter", "glUseProgram", "glVertexAttribPointer", "glVertexAttribIPointer", "glViewport",
+            };
+            for (std::string_view prefix : state_prefixes)
+            {
+                if (starts_with(prefix))
+                    return Kind::state;
+            }
+
+            return Kind::other;
+        }
+
+        // Returns a value-initialized `T`, or nothing if `T` is `void`.
+        template <typename T>
+        T Zero()
+        {
+            if constexpr (!std::is_void_v<T>)
+                return T{};
+        }
+
+        // The size of a pixel in the client memory, for `glTex[Sub]Image*()`. Returns 0 for the unknown formats.
+        [[nodiscard]] static std::uint64_t PixelSize(GLenum format, GLenum type)
+        {
+            std::uint64_t channels = 0;
+            switch (format)
+            {
+                case GL_RED: case GL_DEPTH_COMPONENT: channels = 1; break;
+                #ifdef GL_RG
+                case GL_RG: channels = 2; break;
+                #endif
+                case GL_RGB: channels = 3; break;
+                case GL_RGBA: channels = 4; break;
+                #ifdef GL_BGRA
+                case GL_BGR: channels = 3; break;
+                case GL_BGRA: channels = 4; break;
+                #endif
+            }
+
+            switch (type)
+            {
+                case GL_UNSIGNED_BYTE: case GL_BYTE: return channels;
+                case GL_UNSIGNED_SHORT: case GL_SHORT: return channels * 2;
+                case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT: return channels * 4;
+            }
+            return 0;
+        }
+
+        static void GenHandles(GLsizei n, GLuint *handles)
+        {
+            for (GLsizei i = 0; i < n; i++)
+                handles[i] = Backend().NewHandle();
+        }
+
+        static void GetObjectParam(GLenum pname, GLint *params)
+        {
+            *params = pname == GL_COMPILE_STATUS || pname == GL_LINK_STATUS ? GL_TRUE : 0;
+        }
+
+        // Stubs for the functions that return something meaningful, or carry the data we want to measure.
+        [[nodiscard]] static const std::map<std::string_view, void *> &CustomStubs()
+        {
+            static const std::map<std::string_view, void *> ret = {
+                {"glGenBuffers",      reinterpret_cast<void *>(+[](GLsizei n, GLuint *handles){Backend().Record("glGenBuffers", Kind::other); GenHandles(n, handles);})},
+                {"glGenTextures",     reinterpret_cast<void *>(+[](GLsizei n, GLuint *handles){Backend().Record("glGenTextures", Kind::other); GenHandles(n, handles);})},
+                {"glGenFramebuffers", reinterpret_cast<void *>(+[](GLsizei n, GLuint *handles){Backend().Record("glGenFramebuffers", Kind::other); GenHandles(n, handles);})},
+                {"glGenVertexArrays", reinterpret_cast<void *>(+[](GLsizei n, GLuint *handles){Backend().Record("glGenVertexArrays", Kind::other); GenHandles(n, handles);})},
+                {"glCreateShader",    reinterpret_cast<void *>(+[](GLenum) -> GLuint {Backend().Record("glCreateShader", Kind::other); return Backend().NewHandle();})},
+                {"glCreateProgram",   reinterpret_cast<void *>(+[]() -> GLuint {Backend().Record("glCreateProgram", Kind::other); return Backend().NewHandle();})},
+                {"glGetShaderiv",     reinterpret_cast<void *>(+[](GLuint, GLenum pname, GLint *params){Backend().Record("glGetShaderiv", Kind::other); GetObjectParam(pname, params);})},
+                {"glGetProgramiv",    reinterpret_cast<void *>(+[](GLuint, GLenum pname, GLint *params){Backend().Record("glGetProgramiv", Kind::other); GetObjectParam(pname, params);})},
+                {"glGetUniformLocation", reinterpret_cast<void *>(+[](GLuint, const GLchar *) -> GLint {Backend().Record("glGetUniformLocation", Kind::other); return Backend().NewUniformLocation();})},
+                {"glCheckFramebufferStatus", reinterpret_cast<void *>(+[](GLenum) -> GLenum {Backend().Record("glCheckFramebufferStatus", Kind::other); return GL_FRAMEBUFFER_COMPLETE;})},
+
+                {"glBufferData", reinterpret_cast<void *>(+[](GLenum, GLsizeiptr size, const void *data, GLenum)
+                {
+                    // Without the data, this only allocates the storage.
+                    Backend().Record("glBufferData", data ? Kind::upload : Kind::other, data ? size : 0);
+                })},
+                {"glBufferSubData", reinterpret_cast<void *>(+[](GLenum, GLintptr, GLsizeiptr size, const void *)
+                {
+                    Backend().Record("glBufferSubData", Kind::upload, size);
+                })},
+                {"glTexImage2D", reinterpret_cast<void *>(+[](GLenum, GLint, GLint, GLsizei width, GLsizei height, GLint, GLenum format, GLenum type, const void *pixels)
+                {
+                    Backend().Record("glTexImage2D", pixels ? Kind::upload : Kind::other, pixels ? std::uint64_t(width) * height * PixelSize(format, type) : 0);
+                })},
+                {"glTexSubImage2D", reinterpret_cast<void *>(+[](GLenum, GLint, GLint, GLint, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *)
+                {
+                    Backend().Record("glTexSubImage2D", Kind::upload, std::uint64_t(width) * height * PixelSize(format, type));
+                })},
+                {"glDrawArrays", reinterpret_cast<void *>(+[](GLenum, GLint, GLsizei count)
+                {
+                    Backend().Record("glDrawArrays", Kind::draw, count);
+                })},
+                {"glDrawElements", reinterpret_cast<void *>(+[](GLenum, GLsizei count, GLenum, const void *)
+                {
+                    Backend().Record("glDrawElements", Kind::draw, count);
+                })},
+            };
+            return ret;
+        }
+
+        // The generic stubs for all functions, made from the function list of the loader.
+        // They only record the call, and return zero if they have to return something.
+        [[nodiscard]] static const std::map<std::string_view, void *> &GenericStubs()
+        {
+            #pragma GCC diagnostic push
+            #pragma GCC diagnostic ignored "-Wunused-parameter"
+            #undef CGLFL_CALL
+            #define CGLFL_CALL(i, func, ret, n, param_names, params) \
+                {#func, reinterpret_cast<void *>(+[] params -> ret \
+                { \
+                    static const Kind kind = ClassifyFunction(#func); \
+                    Backend().Record(#func, kind); \
+                    return Zero<ret>(); \
+                })},
+            static const std::map<std::string_view, void *> ret = {CGLFL_PRIMARY_FUNCS};
+            #undef CGLFL_CALL
+            #pragma GCC diagnostic pop
+            return ret;
+        }
+    }
+
+    RecordingBackend::RecordingBackend(bool keep_log) : keep_log(keep_log)
+    {
+        if (instance)
+            Program::Error("Attempt to create multiple recording graphics backends.");
+
+        prev_context = cglfl::context_pointer;
+        cglfl::context_pointer = &context;
+        FINALLY_ON_THROW( cglfl::context_pointer = prev_context; )
+
+        cglfl::load([](const char *name) -> void *
+        {
+            if (auto it = impl::CustomStubs().find(name); it != impl::CustomStubs().end())
+                return it->second;
+            if (auto it = impl::GenericStubs().find(name); it != impl::GenericStubs().end())
+                return it->second;
+            return nullptr;
+        });
+
+        instance = this;
+    }
+
+    RecordingBackend::~RecordingBackend()
+    {
+        cglfl::context_pointer = prev_context;
+        instance = nullptr;
+    }
+
+    void RecordingBackend::Record(const char *function, CommandKind kind, std::uint64_t amount)
+    {
+        stats.calls++;
+        switch (kind)
+        {
+            case CommandKind::other: break;
+            case CommandKind::upload: stats.uploads++; stats.bytes_uploaded += amount; break;
+            case CommandKind::draw: stats.draw_calls++; stats.vertices_drawn += amount; break;
+            case CommandKind::state: stats.state_changes++; break;
+            case CommandKind::uniform: stats.uniform_updates++; break;
+        }
+
+        if (keep_log)
+            log.push_back({function, kind, amount});
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <cglfl/cglfl.hpp>
+
+namespace Graphics
+{
+    // Replaces the OpenGL functions with stubs that record the calls into an in-memory log, instead of executing them.
+    // While it exists, the graphics code (`VertexBuffer`, `Shader`, `Texture`, `SimpleRenderQueue`, etc) works without a GL context,
+    //   which allows testing and benchmarking the CPU side of the rendering.
+    // The stubs return plausible results: `glGen*()` and `glCreate*()` return unique handles, the shaders always compile and link,
+    //   the framebuffers are always complete, and `glGetError()` reports no errors.
+    //   Other query functions return zeroes and don't write to their output parameters.
+    // Only one instance can exist at a time. It loads the stubs into its own `cglfl::context`, and restores the previous one when destroyed.
+    // The graphics objects must not outlive it, since they would call the real GL functions with the fake handles.
+    class RecordingBackend
+    {
+      public:
+        enum class CommandKind
+        {
+            other,
+            upload, // Uploading the buffer or texture data.
+            draw,
+            state, // Binding the objects, and changing the pipeline state (blending, viewport, etc).
+            uniform,
+        };
+
+        struct Command
+        {
+            const char *function = nullptr;
+            CommandKind kind = CommandKind::other;
+            // The amount of bytes for `upload`, the amount of vertices (or indices) for `draw`, otherwise 0.
+            std::uint64_t amount = 0;
+        };
+
+        struct Stats
+        {
+            std::uint64_t calls = 0;
+            std::uint64_t uploads = 0;
+            std::uint64_t bytes_uploaded = 0;
+            std::uint64_t draw_calls = 0;
+            std::uint64_t vertices_drawn = 0;
+            std::uint64_t state_changes = 0;
+            std::uint64_t uniform_updates = 0;
+        };
+
+      private:
+        inline static RecordingBackend *instance = nullptr;
+
+        cglfl::context context;
+        cglfl::context *prev_context = nullptr;
+
+        bool keep_log = true;
+        std::vector<Command> log;
+        Stats stats;
+
+        GLuint last_handle = 0;
+        GLint last_uniform_location = -1;
+
+      public:
+        // If `keep_log` is false, only the `Stats` are collected, which is faster and uses no memory.
+        explicit RecordingBackend(bool keep_log = true);
+
+        RecordingBackend(const RecordingBackend &) = delete;
+        RecordingBackend &operator=(const RecordingBackend &) = delete;
+
+        ~RecordingBackend();
+
+        // Returns the current instance, or null if none.
+        [[nodiscard]] static RecordingBackend *Get()
+        {
+            return instance;
+        }
+
+        // The recorded calls, in order. Empty if `keep_log` was false.
+        [[nodiscard]] const std::vector<Command> &Log() const
+        {
+            return log;
+        }
+
+        [[nodiscard]] const Stats &GetStats() const
+        {
+            return stats;
+        }
+
+        // Forgets the recorded calls and resets the stats.
+        void Reset()
+        {
+            log.clear();
+            stats = {};
+        }
+
+        // Those are used by the stubs.
+        void Record(const char *function, CommandKind kind, std::uint64_t amount = 0);
+        [[nodiscard]] GLuint NewHandle()
+        {
+            return ++last_handle;
+        }
+        [[nodiscard]] GLint NewUniformLocation()
+        {
+            return ++last_uniform_location;
+        }
+    };
+}
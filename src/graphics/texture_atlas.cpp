@@ -6,12 +6,15 @@
 #include "stream/readonly_data.h"
 #include "stream/save_to_file.h"
 #include "utils/packing.h"
+#include "utils/profiler.h"
 
 namespace Graphics
 {
     TextureAtlas::TextureAtlas(ivec2 target_size, const std::string &source_dir, const std::string &out_image_file, const std::string &out_desc_file, bool add_gaps)
         : source_dir(source_dir)
     {
+        PROFILE_SCOPE("TextureAtlas::TextureAtlas");
+
         constexpr int max_nesting_level = 32;
 
         // Decide if regenrating the atlas should be allowed.
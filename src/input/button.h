@@ -16,6 +16,10 @@ namespace Input
 
         void Update() const
         {
+            // Without a window (e.g. when running headless), nothing is ever pressed.
+            if (!Interface::Window::IsOpen())
+                return;
+
             auto &window = Interface::Window::Get();
 
             uint64_t tick = window.Ticks();
@@ -33,6 +37,9 @@ namespace Input
 
         bool Assign(Enum begin, Enum end)
         {
+            if (!Interface::Window::IsOpen())
+                return 0;
+
             auto &window = Interface::Window::Get();
             uint64_t tick = window.Ticks();
 
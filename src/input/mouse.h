@@ -18,6 +18,10 @@ namespace Input
 
         void Update() const
         {
+            // Without a window (e.g. when running headless), the mouse stays still.
+            if (!Interface::Window::IsOpen())
+                return;
+
             // Get window
             auto &window = Interface::Window::Get();
 
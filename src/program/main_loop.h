@@ -1,17 +1,26 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
+#include <cstdio>
 #include <functional>
+#include <iostream>
 #include <optional>
+#include <string>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include <SDL_timer.h>
 
 #include "interface/window.h"
 #include "macros/finally.h"
+#include "utils/allocation_tracking.h"
 #include "utils/clock.h"
 #include "utils/metronome.h"
+#include "utils/profiler.h"
+#include "utils/thread_pool.h"
 
 namespace Program
 {
@@ -25,6 +34,8 @@ namespace Program
 
         virtual void Tick() {}
         virtual void Render() {}
+        // Is called before `Render()`, while no `Tick()`s are running. See `DefaultBasicState::PipelineTicks()`.
+        virtual void PrepareRender() {}
 
         // Should call `BeginFrame()` once, then `Tick()` and `Frame()` 0 or more times, then `EndFrame()`.
         // Should return `false` to indicate that the loop should be stopped.
@@ -50,7 +61,42 @@ namespace Program
         bool executing_frame = false;
         std::uint64_t frame_start = -1;
 
+        // The interpolation factor for the current `Render()`, see `RenderInterpolation()`.
+        double render_interpolation = 0;
+        // In the pipelined mode, the thread that runs the ticks. Is created on the first pipelined frame, and is reused by all the following ones.
+        std::optional<ThreadPool> tick_thread;
+        // In the pipelined mode, the ticks that are currently running, and the interpolation factor for the state they produce.
+        ThreadPool::Group pending_ticks;
+        double pending_interpolation = 0;
+
+        // In the pipelined mode, waits for the ticks started on the previous frame, if any. Rethrows their exceptions.
+        void FinishPendingTicks()
+        {
+            if (tick_thread)
+                tick_thread->Wait(pending_ticks);
+        }
+
+        // Same, but ignores the exceptions. Is used when we're already handling an exception.
+        void FinishPendingTicksNoThrow() noexcept
+        {
+            try
+            {
+                FinishPendingTicks();
+            }
+            catch (...) {}
+        }
+
       public:
+        DefaultBasicState() {}
+
+        DefaultBasicState(const DefaultBasicState &) = delete;
+        DefaultBasicState &operator=(const DefaultBasicState &) = delete;
+
+        ~DefaultBasicState()
+        {
+            FinishPendingTicksNoThrow();
+        }
+
         // Returns the metronome, or `nullptr` if want to run one tick per frame.
         virtual Metronome *GetTickMetronome() {return nullptr;}
 
@@ -65,6 +111,23 @@ namespace Program
         // Returns target FPS. `<= 0` if not limited.
         virtual int GetFpsCap() {return 0;}
 
+        // If this returns true, the ticks of each frame run on a separate thread, while the main thread renders the previous frame.
+        // Then the frame order is: wait for the previous ticks, `BeginFrame()`, `PrepareRender()`, start the new ticks, `Render()`, `EndFrame()`.
+        // The main loop only provides the hook, it doesn't copy anything by itself. `Render()` must not read anything that `Tick()` writes,
+        //   so the state must implement the double buffering: `PrepareRender()` copies everything `Render()` needs into a snapshot,
+        //   then the ticks advance the live state, while `Render()` reads the snapshot.
+        // `Tick()` must not touch the window or the graphics, process the events in `BeginFrame()` instead, which runs while no ticks are running.
+        // The ticks run on a single long-lived worker thread, one batch per frame.
+        // The latency is bounded: at most one frame worth of ticks is in flight, and the rendered state is at most one frame old.
+        virtual bool PipelineTicks() {return false;}
+
+        // Returns the fraction of a tick (from 0 to 1) that passed since the last tick of the state being rendered,
+        //   as reported by `Metronome::Time()`. Use it to interpolate the positions in `Render()`. Always 0 without a metronome.
+        [[nodiscard]] double RenderInterpolation() const
+        {
+            return render_interpolation;
+        }
+
         // Ignored if FPS cap is disabled.
         // FPS is capped by adding a delay after frames that are too short.
         // The delay will be partially created using a `sleep` function, and partially using a busy loop.
@@ -80,6 +143,13 @@ namespace Program
                 return !stop;
             executing_frame = true;
             FINALLY( executing_frame = false; )
+            // If we throw, wait for the pending ticks, since they can reference the state being destroyed.
+            FINALLY_ON_THROW( FinishPendingTicksNoThrow(); )
+
+            // Everything since the previous call is attributed to the previous frame.
+            AllocationTracking::NextFrame();
+
+            PROFILE_SCOPE("Frame");
 
             // Load some basic config from state.
             auto *metronome = GetTickMetronome();
@@ -98,25 +168,92 @@ namespace Program
                 frame_start = new_frame_start;
             }
 
+            bool pipeline_ticks = PipelineTicks();
+
+            // In the pipelined mode, finish the ticks of the previous frame first, so `BeginFrame()` can update the state they read.
+            if (pipeline_ticks)
+            {
+                PROFILE_SCOPE("Wait for ticks");
+                FinishPendingTicks();
+            }
+
             // Begin frame.
-            BeginFrame();
+            {
+                PROFILE_SCOPE("BeginFrame");
+                BeginFrame();
+            }
 
-            // Tick.
-            if (metronome)
+            if (pipeline_ticks)
             {
-                while (metronome->Tick(delta))
-                    Tick();
+                // Count the ticks on this thread, since the metronome is not thread-safe.
+                int tick_count = 1;
+                if (metronome)
+                {
+                    tick_count = 0;
+                    while (metronome->Tick(delta))
+                        tick_count++;
+                }
+
+                // Snapshot the results of the previous ticks.
+                {
+                    PROFILE_SCOPE("PrepareRender");
+                    PrepareRender();
+                }
+                render_interpolation = pending_interpolation;
+
+                // Start the ticks of this frame.
+                pending_interpolation = metronome ? metronome->Time() : 0;
+                if (!tick_thread)
+                    tick_thread.emplace(1);
+                tick_thread->Submit(pending_ticks, [this, tick_count]
+                {
+                    for (int i = 0; i < tick_count; i++)
+                    {
+                        PROFILE_SCOPE("Tick");
+                        Tick();
+                    }
+                });
+
+                // Render the snapshot.
+                {
+                    PROFILE_SCOPE("Render");
+                    Render();
+                }
             }
             else
             {
-                Tick();
-            }
+                // Tick.
+                if (metronome)
+                {
+                    while (metronome->Tick(delta))
+                    {
+                        PROFILE_SCOPE("Tick");
+                        Tick();
+                    }
+                }
+                else
+                {
+                    PROFILE_SCOPE("Tick");
+                    Tick();
+                }
 
-            // Render.
-            Render();
+                // Render.
+                {
+                    PROFILE_SCOPE("PrepareRender");
+                    PrepareRender();
+                }
+                render_interpolation = metronome ? metronome->Time() : 0;
+                {
+                    PROFILE_SCOPE("Render");
+                    Render();
+                }
+            }
 
             // End frame.
-            EndFrame();
+            {
+                PROFILE_SCOPE("EndFrame");
+                EndFrame();
+            }
 
             // Cap FPS.
             if (have_fps_cap)
@@ -128,6 +265,8 @@ namespace Program
                 // If necessary, add a delay.
                 if (frame_len < desired_frame_len)
                 {
+                    PROFILE_SCOPE("FPS cap");
+
                     int sleep_ms = (desired_frame_len - frame_len) * 1000 / clock_ticks_per_sec;
 
                     auto busy_loop_len_ms = GetFpsCapPreferredBusyLoopDurationMs();
@@ -149,6 +288,134 @@ namespace Program
                 }
             }
 
+            // Don't leave the ticks running when the loop stops.
+            if (stop)
+                FinishPendingTicks();
+
+            return !stop;
+        }
+    };
+
+    // A main loop without a window, graphics or timing, for benchmarking and soak-testing the simulation.
+    // Each frame is `BeginFrame()`, a single `Tick()`, then `EndFrame()`, running as fast as possible. `Render()` and `PrepareRender()` are never called.
+    // Periodically prints the ticks per second to `std::cout`. When stopping, prints a summary,
+    //   with the time spent in each profiler zone (which includes every action in `ActionSequence::Run()` and `ActionSequence::ForEach()`).
+    // Enables the profiler and repeatedly `Profiler::Clear()`s it to collect the zone statistics.
+    class HeadlessBasicState : public BasicState
+    {
+        using clock = std::chrono::steady_clock;
+
+        bool executing_frame = false;
+        std::uint64_t tick_counter = 0;
+        clock::time_point start_time, last_report_time;
+        std::uint64_t last_report_tick = 0;
+        Profiler::ZoneStatsMap zone_stats;
+
+        // How often to collect the profiler zones. Must be small enough to not overflow the profiler ring buffers.
+        static constexpr std::uint64_t collect_zones_interval = 256;
+
+        [[nodiscard]] static double Seconds(clock::duration duration)
+        {
+            return std::chrono::duration<double>(duration).count();
+        }
+
+        void CollectZones()
+        {
+            Profiler::AccumulateZoneStats(zone_stats);
+            Profiler::Clear();
+        }
+
+      protected:
+        bool stop = false;
+
+      public:
+        // Returns the amount of ticks to run before stopping, or 0 to run until `stop` is set.
+        virtual std::uint64_t GetTickLimit() {return 0;}
+
+        // Returns how often to print the ticks per second, in seconds. If `<= 0`, only the final summary is printed.
+        virtual double GetReportIntervalSec() {return 1;}
+
+        // The amount of ticks performed so far.
+        [[nodiscard]] std::uint64_t TickCounter() const
+        {
+            return tick_counter;
+        }
+
+        // Prints the total ticks per second, and the zone statistics.
+        void PrintSummary()
+        {
+            double elapsed = Seconds(clock::now() - start_time);
+            std::cout << "Ticks: " << tick_counter << ", seconds: " << elapsed << ", TPS: " << (elapsed > 0 ? tick_counter / elapsed : 0) << "\n";
+
+            std::vector<std::pair<const std::string *, const Profiler::ZoneStats *>> zones;
+            for (const auto &[name, stats] : zone_stats)
+                zones.emplace_back(&name, &stats);
+            std::sort(zones.begin(), zones.end(), [](const auto &a, const auto &b){return a.second->total_ns > b.second->total_ns;});
+
+            char line[256];
+            std::snprintf(line, sizeof line, "%12s %12s %12s %12s %14s  %s", "count", "total ms", "avg us/tick", "max us", "allocs/tick", "zone");
+            std::cout << line << '\n';
+            for (const auto &[name, stats] : zones)
+            {
+                double ticks = std::max(tick_counter, std::uint64_t(1));
+                std::snprintf(line, sizeof line, "%12llu %12.3f %12.3f %12.3f %14.2f  ", (unsigned long long)stats->count, stats->total_ns / 1e6,
+                    stats->total_ns / 1e3 / ticks, stats->max_ns / 1e3, stats->allocs.allocations / ticks);
+                std::cout << line << *name << '\n';
+            }
+            std::cout << std::flush;
+        }
+
+        bool RunSingleFrame() override
+        {
+            if (executing_frame)
+                return !stop;
+            executing_frame = true;
+            FINALLY( executing_frame = false; )
+
+            if (tick_counter == 0)
+            {
+                Profiler::SetEnabled(true);
+                Profiler::Clear();
+                start_time = last_report_time = clock::now();
+            }
+
+            AllocationTracking::NextFrame();
+
+            {
+                PROFILE_SCOPE("Frame");
+                BeginFrame();
+                {
+                    PROFILE_SCOPE("Tick");
+                    Tick();
+                }
+                EndFrame();
+            }
+            tick_counter++;
+
+            if (tick_counter % collect_zones_interval == 0)
+                CollectZones();
+
+            if (double interval = GetReportIntervalSec(); interval > 0)
+            {
+                clock::time_point now = clock::now();
+                double elapsed = Seconds(now - last_report_time);
+                if (elapsed >= interval)
+                {
+                    std::cout << "TPS: " << (tick_counter - last_report_tick) / elapsed << std::endl;
+                    last_report_time = now;
+                    last_report_tick = tick_counter;
+                }
+            }
+
+            if (std::uint64_t limit = GetTickLimit(); limit > 0 && tick_counter >= limit)
+                stop = true;
+
+            if (stop)
+            {
+                CollectZones();
+                PrintSummary();
+            }
+
             return !stop;
         }
     };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <limits>
+#include <vector>
 
 #include "meta/basic.h"
 #include "meta/lists.h"
@@ -15,6 +16,14 @@ namespace Refl
     // it has an explicitly polymorphic base (i.e. with `REFL_POLYMORPHIC`).
     struct DontRegisterAsPolymorphic : BasicClassAttribute {};
 
+    // A base for class attributes that should be accessible at runtime through `Polymorphic::RuntimeClassAttribs()`.
+    // For each registered polymorphic class, a static default-constructed instance of each such attribute is created.
+    // Use `dynamic_cast` to check the attribute types.
+    struct RuntimeClassAttribute : BasicClassAttribute
+    {
+        virtual ~RuntimeClassAttribute() = default;
+    };
+
     namespace impl
     {
         using polymorphic_index_binary_t = std::uint16_t; // Keep this unsigned, or adjust the validation logic below.
@@ -91,6 +100,7 @@ namespace Refl
                         void (*zrefl_FromString)(PolyStorage &object, Stream::Input &output, const FromStringOptions &options, Refl::impl::FromStringState state) = nullptr;
                         void (*zrefl_ToBinary)(const PolyStorage &object, Stream::Output &output, const ToBinaryOptions &options, Refl::impl::ToBinaryState state) = nullptr;
                         void (*zrefl_FromBinary)(PolyStorage &object, Stream::Input &output, const FromBinaryOptions &options, Refl::impl::FromBinaryState state) = nullptr;
+                        const std::vector<const RuntimeClassAttribute *> &(*zrefl_RuntimeClassAttribs)() = nullptr;
 
                         // Required by `Poly::Storage`. Assigns correct values to the fields above.
                         template <typename Derived> constexpr void _make()
@@ -126,6 +136,23 @@ namespace Refl
                             {
                                 Interface<Derived>().FromBinary(object.template derived<Derived>(), output, options, state.PartOfRepresentation(options));
                             };
+
+                            zrefl_RuntimeClassAttribs = []() -> const std::vector<const RuntimeClassAttribute *> &
+                            {
+                                static const std::vector<const RuntimeClassAttribute *> ret = []<typename ...A>(Meta::type_list<A...>)
+                                {
+                                    std::vector<const RuntimeClassAttribute *> ret;
+                                    ([&]{
+                                        if constexpr (std::is_base_of_v<RuntimeClassAttribute, A>)
+                                        {
+                                            static const A attrib;
+                                            ret.push_back(&attrib);
+                                        }
+                                    }(), ...);
+                                    return ret;
+                                }(Class::class_attribs<Derived>{});
+                                return ret;
+                            };
                         }
                     };
 
@@ -381,6 +408,19 @@ namespace Refl
             return object.dynamic().zrefl_Name;
         }
 
+        // Returns the class attributes of the stored class that inherit from `RuntimeClassAttribute`.
+        // If the object is null, an empty list is returned.
+        template <typename T> [[nodiscard]] const std::vector<const RuntimeClassAttribute *> &RuntimeClassAttribs(const PolyStorage<T> &object)
+        {
+            impl::Data::FinalizeIfNeeded();
+            if (!object)
+            {
+                static const std::vector<const RuntimeClassAttribute *> empty;
+                return empty;
+            }
+            return object.dynamic().zrefl_RuntimeClassAttribs();
+        }
+
         // Returns the index of the class named `name`, derived from `T`.
         // Throws on failure.
         template <typename T> [[nodiscard]] std::size_t NameToIndex(const char *name)
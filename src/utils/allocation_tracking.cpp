@@ -0,0 +1,96 @@
+#include "allocation_tracking.h"
+
+#if IMP_ALLOCATION_TRACKING
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#include "program/platform.h"
+
+#if PLATFORM_IS(windows)
+#include <malloc.h>
+#endif
+
+// The replacements for the global allocation functions. They forward to `malloc()` and count the allocations.
+// The deallocation functions have to be replaced too, to match the allocation functions.
+
+namespace AllocationTracking::impl
+{
+    static void *Malloc(std::size_t size) noexcept
+    {
+        return std::malloc(size ? size : 1);
+    }
+
+    static void *MallocAligned(std::size_t size, std::align_val_t alignment) noexcept
+    {
+        std::size_t align = std::size_t(alignment);
+        #if PLATFORM_IS(windows)
+        return _aligned_malloc(size ? size : 1, align);
+        #else
+        // `aligned_alloc()` requires the size to be a non-zero multiple of the alignment.
+        return std::aligned_alloc(align, std::max((size + align - 1) / align * align, align));
+        #endif
+    }
+
+    static void FreeAligned(void *ptr) noexcept
+    {
+        #if PLATFORM_IS(windows)
+        _aligned_free(ptr);
+        #else
+        std::free(ptr);
+        #endif
+    }
+
+    // Counts the allocation, then calls `allocate()` until it succeeds.
+    // Like the standard `operator new`, calls the new-handler after each failure, and throws `std::bad_alloc` if there is none.
+    template <typename F>
+    static void *AllocateOrThrow(std::size_t size, F &&allocate)
+    {
+        OnAllocation(size);
+        while (true)
+        {
+            if (void *ptr = allocate())
+                return ptr;
+
+            std::new_handler handler = std::get_new_handler();
+            if (!handler)
+                throw std::bad_alloc();
+            handler();
+        }
+    }
+
+    // Counts the allocation, then returns null on failure.
+    template <typename F>
+    static void *AllocateOrNull(std::size_t size, F &&allocate) noexcept
+    {
+        OnAllocation(size);
+        return allocate();
+    }
+}
+
+namespace AT = AllocationTracking::impl;
+
+void *operator new  (std::size_t size) {return AT::AllocateOrThrow(size, [&]{return AT::Malloc(size);});}
+void *operator new[](std::size_t size) {return AT::AllocateOrThrow(size, [&]{return AT::Malloc(size);});}
+void *operator new  (std::size_t size, const std::nothrow_t &) noexcept {return AT::AllocateOrNull(size, [&]{return AT::Malloc(size);});}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {return AT::AllocateOrNull(size, [&]{return AT::Malloc(size);});}
+void *operator new  (std::size_t size, std::align_val_t alignment) {return AT::AllocateOrThrow(size, [&]{return AT::MallocAligned(size, alignment);});}
+void *operator new[](std::size_t size, std::align_val_t alignment) {return AT::AllocateOrThrow(size, [&]{return AT::MallocAligned(size, alignment);});}
+void *operator new  (std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {return AT::AllocateOrNull(size, [&]{return AT::MallocAligned(size, alignment);});}
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {return AT::AllocateOrNull(size, [&]{return AT::MallocAligned(size, alignment);});}
+
+void operator delete  (void *ptr) noexcept {std::free(ptr);}
+void operator delete[](void *ptr) noexcept {std::free(ptr);}
+void operator delete  (void *ptr, std::size_t) noexcept {std::free(ptr);}
+void operator delete[](void *ptr, std::size_t) noexcept {std::free(ptr);}
+void operator delete  (void *ptr, const std::nothrow_t &) noexcept {std::free(ptr);}
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {std::free(ptr);}
+void operator delete  (void *ptr, std::align_val_t) noexcept {AT::FreeAligned(ptr);}
+void operator delete[](void *ptr, std::align_val_t) noexcept {AT::FreeAligned(ptr);}
+void operator delete  (void *ptr, std::size_t, std::align_val_t) noexcept {AT::FreeAligned(ptr);}
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept {AT::FreeAligned(ptr);}
+void operator delete  (void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {AT::FreeAligned(ptr);}
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {AT::FreeAligned(ptr);}
+
+#endif
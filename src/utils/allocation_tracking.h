@@ -0,0 +1,192 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "program/errors.h"
+
+/* Heap allocation tracking, to find the hidden allocations that cause frame spikes.
+ *
+ * `allocation_tracking.cpp` replaces the global `operator new`. The replacement forwards to `malloc()`,
+ *   and, if the tracking is enabled with `SetEnabled(true)`, counts the allocations and the allocated bytes.
+ * The counts are available:
+ * - In total, see `TotalCounters()`.
+ * - Per frame, see `FrameHistory()`. The main loop calls `NextFrame()` to separate the frames.
+ * - Per profiler zone, see `utils/profiler.h`. Those only count the allocations made by the thread owning the zone.
+ *
+ * `FORBID_ALLOCATIONS()` is a debug assertion that fails if the current thread allocates until the end of the scope,
+ *   regardless of whether the tracking is enabled or not. Like `ASSERT()`, it does nothing if the assertions are disabled.
+ *
+ * The tracking is disabled by default. A disabled hook costs one thread-local check and one relaxed atomic load per allocation.
+ * Define `IMP_ALLOCATION_TRACKING` to 0 to not replace `operator new` at all.
+ */
+
+// Setting this to 0 disables the `operator new` replacement.
+// The benchmarks set it to 0, since they don't link `allocation_tracking.cpp`.
+#ifndef IMP_ALLOCATION_TRACKING
+#  define IMP_ALLOCATION_TRACKING 1
+#endif
+
+#define FORBID_ALLOCATIONS() FORBID_ALLOCATIONS_impl(__LINE__)
+#define FORBID_ALLOCATIONS_impl(line) FORBID_ALLOCATIONS_impl_low(line)
+#define FORBID_ALLOCATIONS_impl_low(line) ::AllocationTracking::ForbidAllocations _forbid_allocations_##line(IMP_RE_ENABLE_ASSERTIONS, __FILE__ ":" #line)
+
+namespace AllocationTracking
+{
+    // Whether `operator new` is replaced. If not, all counters remain zero.
+    inline constexpr bool available = IMP_ALLOCATION_TRACKING;
+
+    struct Counters
+    {
+        std::uint64_t allocations = 0;
+        std::uint64_t bytes = 0;
+
+        [[nodiscard]] friend Counters operator-(const Counters &a, const Counters &b)
+        {
+            return {a.allocations - b.allocations, a.bytes - b.bytes};
+        }
+    };
+
+    namespace impl
+    {
+        inline std::atomic<bool> enabled = false;
+
+        inline std::atomic<std::uint64_t> total_allocations = 0;
+        inline std::atomic<std::uint64_t> total_bytes = 0;
+
+        struct ThreadState
+        {
+            // Only counted while the tracking is enabled.
+            Counters counters;
+
+            // The nesting level of `ForbidAllocations`, and the location of the innermost one.
+            int forbid_depth = 0;
+            const char *forbid_context = nullptr;
+        };
+        // This must stay trivial, since it's accessed by `operator new` when the thread starts and exits.
+        inline thread_local ThreadState this_thread;
+
+        // Called by `operator new`.
+        inline void OnAllocation(std::size_t size)
+        {
+            ThreadState &thread = this_thread;
+            if (thread.forbid_depth > 0)
+            {
+                // Reset the depth first, since the error message allocates.
+                thread.forbid_depth = 0;
+                Program::HardError("Allocation of ", size, " bytes in a scope where allocations are forbidden.\n   at   ", thread.forbid_context);
+            }
+
+            if (!enabled.load(std::memory_order_relaxed))
+                return;
+
+            thread.counters.allocations++;
+            thread.counters.bytes += size;
+            total_allocations.fetch_add(1, std::memory_order_relaxed);
+            total_bytes.fetch_add(size, std::memory_order_relaxed);
+        }
+
+        struct History
+        {
+            static constexpr std::size_t capacity = 240;
+
+            std::mutex mutex;
+            std::array<Counters, capacity> frames{};
+            // The amount of frames recorded so far.
+            std::uint64_t frame_count = 0;
+            // `TotalCounters()` at the beginning of the current frame.
+            Counters frame_start;
+        };
+
+        [[nodiscard]] inline History &GetHistory()
+        {
+            static History ret;
+            return ret;
+        }
+    }
+
+    // Enables or disables counting the allocations. Disabled by default.
+    inline void SetEnabled(bool enabled)
+    {
+        impl::enabled.store(enabled, std::memory_order_relaxed);
+    }
+    [[nodiscard]] inline bool IsEnabled()
+    {
+        return available && impl::enabled.load(std::memory_order_relaxed);
+    }
+
+    // The allocations made by all threads so far.
+    [[nodiscard]] inline Counters TotalCounters()
+    {
+        return {impl::total_allocations.load(std::memory_order_relaxed), impl::total_bytes.load(std::memory_order_relaxed)};
+    }
+
+    // The allocations made by the current thread so far.
+    [[nodiscard]] inline Counters ThisThreadCounters()
+    {
+        return impl::this_thread.counters;
+    }
+
+    // Finishes the current frame, and adds its counters to the history. The main loop calls this once per frame.
+    inline void NextFrame()
+    {
+        impl::History &history = impl::GetHistory();
+        Counters total = TotalCounters();
+        std::lock_guard lock(history.mutex);
+        history.frames[history.frame_count++ % impl::History::capacity] = total - history.frame_start;
+        history.frame_start = total;
+    }
+
+    // Returns the allocations made by all threads during the last `count` frames, from oldest to newest.
+    // Calls `func(const Counters &)` for each frame. If less frames were recorded, the missing frames are reported as zeroes.
+    template <typename F>
+    void FrameHistory(std::size_t count, F &&func)
+    {
+        impl::History &history = impl::GetHistory();
+        std::lock_guard lock(history.mutex);
+        count = std::min(count, impl::History::capacity);
+        for (std::size_t i = count; i > 0; i--)
+        {
+            if (i > history.frame_count)
+                func(Counters{});
+            else
+                func(history.frames[(history.frame_count - i) % impl::History::capacity]);
+        }
+    }
+
+    // Use `FORBID_ALLOCATIONS()` instead of using this directly.
+    class ForbidAllocations
+    {
+        bool active = false;
+        const char *prev_context = nullptr;
+
+      public:
+        ForbidAllocations(bool active, const char *context) : active(active && available)
+        {
+            if (this->active)
+            {
+                impl::ThreadState &thread = impl::this_thread;
+                prev_context = thread.forbid_context;
+                thread.forbid_context = context;
+                thread.forbid_depth++;
+            }
+        }
+
+        ForbidAllocations(const ForbidAllocations &) = delete;
+        ForbidAllocations &operator=(const ForbidAllocations &) = delete;
+
+        ~ForbidAllocations()
+        {
+            if (active)
+            {
+                impl::ThreadState &thread = impl::this_thread;
+                thread.forbid_context = prev_context;
+                thread.forbid_depth--;
+            }
+        }
+    };
+}
@@ -0,0 +1,402 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "stream/output.h"
+#include "utils/allocation_tracking.h"
+
+/* A hierarchical CPU profiler.
+ *
+ * `PROFILE_SCOPE("name")` measures the time until the end of the current scope, and records it as a zone.
+ * The name must be a string with the static storage duration (e.g. a string literal).
+ * Nested zones form a hierarchy, which is reconstructed from the timestamps when viewing the trace.
+ *
+ * Each thread records its zones into its own ring buffer, keeping the last `impl::ThreadBuffer::capacity` zones.
+ * When a thread exits, its buffer is kept (so its zones can still be exported), and is reused by the next thread that records a zone.
+ *   This way the memory usage depends on the max amount of simultaneously running threads, rather than the amount of threads ever created.
+ * Recording a zone doesn't lock anything, and the buffers can be exported while the other threads keep recording.
+ * `ExportChromeTrace()` writes them in the Chrome `trace_event` JSON format, viewable in `chrome://tracing` or Perfetto.
+ *
+ * The profiler is disabled until `SetEnabled(true)`. A disabled zone costs one relaxed atomic load.
+ * Define `IMP_PROFILER_ENABLED` to 0 to compile the zones away completely.
+ *
+ * If the allocation tracking is enabled (see `utils/allocation_tracking.h`), each zone also records the amount of allocations
+ *   made by its thread while it was active (including the nested zones). They are exported as the zone arguments.
+ */
+
+// Setting this to 0 makes `PROFILE_SCOPE()` expand to nothing.
+#ifndef IMP_PROFILER_ENABLED
+#  define IMP_PROFILER_ENABLED 1
+#endif
+
+#if IMP_PROFILER_ENABLED
+#  define PROFILE_SCOPE(name) ::Profiler::Zone PROFILE_impl_cat(_profiler_zone_,__LINE__)(name)
+#else
+#  define PROFILE_SCOPE(name) do {} while (false)
+#endif
+
+#define PROFILE_impl_cat(a, b) PROFILE_impl_cat_(a, b)
+#define PROFILE_impl_cat_(a, b) a##b
+
+namespace Profiler
+{
+    namespace impl
+    {
+        // A single recorded zone.
+        // The fields are atomic only to allow reading them while they are being overwritten. The torn reads are detected and discarded.
+        struct Event
+        {
+            std::atomic<const char *> name = nullptr;
+            std::atomic<std::uint64_t> begin_ns = 0;
+            std::atomic<std::uint64_t> end_ns = 0;
+            std::atomic<std::uint64_t> allocations = 0;
+            std::atomic<std::uint64_t> allocated_bytes = 0;
+        };
+
+        // A ring buffer of zones for a single thread. Only the owning thread writes to it.
+        struct ThreadBuffer
+        {
+            static constexpr std::size_t capacity = 0x10000;
+
+            std::size_t thread_index = 0;
+            // Protected by the registry mutex.
+            std::string thread_name;
+
+            // Allocated on the first `Push()`.
+            std::unique_ptr<Event[]> events;
+            // The amount of events that were started and finished being written, respectively.
+            // The readers use them to detect the events that were overwritten while being read.
+            std::atomic<std::uint64_t> started = 0;
+            std::atomic<std::uint64_t> finished = 0;
+            // The events before this index are ignored, see `Clear()`.
+            std::atomic<std::uint64_t> cleared = 0;
+
+            void Push(const char *name, std::uint64_t begin_ns, std::uint64_t end_ns, AllocationTracking::Counters allocs)
+            {
+                if (!events)
+                    events = std::make_unique<Event[]>(capacity);
+
+                std::uint64_t index = finished.load(std::memory_order_relaxed);
+                started.store(index + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+
+                Event &event = events[index % capacity];
+                event.name.store(name, std::memory_order_relaxed);
+                event.begin_ns.store(begin_ns, std::memory_order_relaxed);
+                event.end_ns.store(end_ns, std::memory_order_relaxed);
+                event.allocations.store(allocs.allocations, std::memory_order_relaxed);
+                event.allocated_bytes.store(allocs.bytes, std::memory_order_relaxed);
+
+                finished.store(index + 1, std::memory_order_release);
+            }
+        };
+
+        struct Registry
+        {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<ThreadBuffer>> threads;
+            // The buffers of the threads that exited, to be reused by the new threads.
+            std::vector<ThreadBuffer *> free_threads;
+        };
+
+        // The registry is never destroyed, because the threads can record zones during the static destruction.
+        [[nodiscard]] inline Registry &GetRegistry()
+        {
+            static Registry &ret = *new Registry;
+            return ret;
+        }
+
+        inline std::atomic<bool> enabled = false;
+
+        // Set when the thread-local `ThreadBufferOwner` is destroyed. Trivially destructible, so it can be checked after that.
+        inline thread_local bool this_thread_exiting = false;
+
+        // Returns the buffer of the current thread to the registry when the thread exits.
+        struct ThreadBufferOwner
+        {
+            ThreadBuffer *buffer = nullptr;
+
+            ThreadBufferOwner() {}
+            ThreadBufferOwner(const ThreadBufferOwner &) = delete;
+            ThreadBufferOwner &operator=(const ThreadBufferOwner &) = delete;
+
+            ~ThreadBufferOwner()
+            {
+                this_thread_exiting = true;
+                if (buffer)
+                {
+                    Registry &registry = GetRegistry();
+                    std::lock_guard lock(registry.mutex);
+                    registry.free_threads.push_back(buffer);
+                }
+            }
+        };
+
+        // Returns the buffer of the current thread, reusing a buffer of an exited thread if possible.
+        // Returns null if the thread is exiting and already gave its buffer back.
+        [[nodiscard]] inline ThreadBuffer *ThisThreadBuffer()
+        {
+            if (this_thread_exiting)
+                return nullptr;
+
+            thread_local ThreadBufferOwner owner;
+            if (!owner.buffer)
+            {
+                Registry &registry = GetRegistry();
+                std::lock_guard lock(registry.mutex);
+                if (registry.free_threads.empty())
+                {
+                    owner.buffer = registry.threads.emplace_back(std::make_unique<ThreadBuffer>()).get();
+                    owner.buffer->thread_index = registry.threads.size() - 1;
+                }
+                else
+                {
+                    // Forget the zones of the previous owner, so they aren't attributed to this thread.
+                    owner.buffer = registry.free_threads.back();
+                    registry.free_threads.pop_back();
+                    owner.buffer->thread_name.clear();
+                    owner.buffer->cleared.store(owner.buffer->finished.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                }
+            }
+            return owner.buffer;
+        }
+
+        [[nodiscard]] inline std::uint64_t Now()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        // A copy of an `Event`.
+        struct Entry
+        {
+            const char *name = nullptr;
+            std::uint64_t begin_ns = 0;
+            std::uint64_t end_ns = 0;
+            AllocationTracking::Counters allocs;
+        };
+
+        // Copies the recorded events of a thread into `entries` (replacing its contents), skipping the ones that were overwritten while being read.
+        // The registry mutex must be locked.
+        inline void ReadThreadEntries(const ThreadBuffer &thread, std::vector<Entry> &entries)
+        {
+            entries.clear();
+
+            std::uint64_t end = thread.finished.load(std::memory_order_acquire);
+            if (end == 0)
+                return; // No events, and maybe not even allocated.
+            std::uint64_t begin = std::max({thread.cleared.load(std::memory_order_relaxed), end - std::min(end, std::uint64_t(ThreadBuffer::capacity))});
+
+            for (std::uint64_t i = begin; i < end; i++)
+            {
+                const Event &event = thread.events[i % ThreadBuffer::capacity];
+                entries.push_back({event.name.load(std::memory_order_relaxed), event.begin_ns.load(std::memory_order_relaxed), event.end_ns.load(std::memory_order_relaxed),
+                    {event.allocations.load(std::memory_order_relaxed), event.allocated_bytes.load(std::memory_order_relaxed)}});
+            }
+
+            // Discard the events that could've been overwritten while we were reading them.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            std::uint64_t started = thread.started.load(std::memory_order_relaxed);
+            std::size_t first_valid = started > begin + ThreadBuffer::capacity ? started - begin - ThreadBuffer::capacity : 0;
+            entries.erase(entries.begin(), entries.begin() + std::min(first_valid, entries.size()));
+        }
+    }
+
+    // Enables or disables recording the zones. Disabled by default.
+    // The zones that started while the profiler was disabled aren't recorded.
+    inline void SetEnabled(bool enabled)
+    {
+        impl::enabled.store(enabled, std::memory_order_relaxed);
+    }
+    [[nodiscard]] inline bool IsEnabled()
+    {
+        return impl::enabled.load(std::memory_order_relaxed);
+    }
+
+    // Sets the name of the current thread, as shown in the exported traces.
+    inline void SetThreadName(std::string name)
+    {
+        impl::ThreadBuffer *buffer = impl::ThisThreadBuffer();
+        if (!buffer)
+            return;
+        std::lock_guard lock(impl::GetRegistry().mutex);
+        buffer->thread_name = std::move(name);
+    }
+
+    // Forgets all recorded zones.
+    inline void Clear()
+    {
+        impl::Registry &registry = impl::GetRegistry();
+        std::lock_guard lock(registry.mutex);
+        for (const auto &thread : registry.threads)
+            thread->cleared.store(thread->finished.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+
+    // Use `PROFILE_SCOPE()` instead of using this directly.
+    class Zone
+    {
+        impl::ThreadBuffer *buffer = nullptr;
+        const char *name = nullptr;
+        std::uint64_t begin_ns = 0;
+        AllocationTracking::Counters begin_allocs;
+
+      public:
+        explicit Zone(const char *name)
+        {
+            if (IsEnabled())
+            {
+                buffer = impl::ThisThreadBuffer();
+                this->name = name;
+                begin_allocs = AllocationTracking::ThisThreadCounters();
+                begin_ns = impl::Now();
+            }
+        }
+
+        Zone(const Zone &) = delete;
+        Zone &operator=(const Zone &) = delete;
+
+        ~Zone()
+        {
+            if (buffer)
+            {
+                std::uint64_t end_ns = impl::Now();
+                buffer->Push(name, begin_ns, end_ns, AllocationTracking::ThisThreadCounters() - begin_allocs);
+            }
+        }
+    };
+
+    // Writes the recorded zones of all threads in the Chrome `trace_event` JSON format.
+    // Can be called while other threads are recording.
+    inline void ExportChromeTrace(Stream::Output &output)
+    {
+        // Writes a string as a JSON string literal.
+        auto write_string = [&](const char *str)
+        {
+            output.WriteChar('"');
+            for (; *str; str++)
+            {
+                unsigned char ch = *str;
+                if (ch == '"' || ch == '\\')
+                {
+                    output.WriteChar('\\');
+                    output.WriteChar(ch);
+                }
+                else if (ch < 0x20)
+                {
+                    const char *digits = "0123456789abcdef";
+                    output.WriteString("\\u00");
+                    output.WriteChar(digits[ch >> 4]);
+                    output.WriteChar(digits[ch & 15]);
+                }
+                else
+                {
+                    output.WriteChar(ch);
+                }
+            }
+            output.WriteChar('"');
+        };
+        // Writes a nanosecond duration in microseconds.
+        auto write_us = [&](std::uint64_t ns)
+        {
+            std::string fraction = std::to_string(ns % 1000);
+            output.WriteString(std::to_string(ns / 1000) + "." + std::string(3 - fraction.size(), '0') + fraction);
+        };
+
+        bool first_entry = true;
+        auto begin_entry = [&]
+        {
+            output.WriteString(first_entry ? "\n" : ",\n");
+            first_entry = false;
+        };
+
+        output.WriteString("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+        impl::Registry &registry = impl::GetRegistry();
+        std::lock_guard lock(registry.mutex);
+
+        std::vector<impl::Entry> entries;
+        for (const auto &thread : registry.threads)
+        {
+            std::string tid = std::to_string(thread->thread_index);
+
+            begin_entry();
+            output.WriteString("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" + tid + ",\"args\":{\"name\":");
+            write_string(thread->thread_name.empty() ? ("Thread " + tid).c_str() : thread->thread_name.c_str());
+            output.WriteString("}}");
+
+            impl::ReadThreadEntries(*thread, entries);
+            for (const impl::Entry &entry : entries)
+            {
+                begin_entry();
+                output.WriteString("{\"name\":");
+                write_string(entry.name);
+                output.WriteString(",\"ph\":\"X\",\"pid\":0,\"tid\":" + tid + ",\"ts\":");
+                write_us(entry.begin_ns);
+                output.WriteString(",\"dur\":");
+                write_us(entry.end_ns - entry.begin_ns);
+                if (entry.allocs.allocations > 0)
+                    output.WriteString(",\"args\":{\"allocations\":" + std::to_string(entry.allocs.allocations) + ",\"bytes\":" + std::to_string(entry.allocs.bytes) + "}");
+                output.WriteChar('}');
+            }
+        }
+
+        output.WriteString("\n]}\n");
+    }
+
+    // Same, but writes to a file.
+    inline void ExportChromeTrace(const std::string &file_name)
+    {
+        Stream::Output output(file_name);
+        ExportChromeTrace(output);
+        output.Flush();
+    }
+
+    // The summary of all recorded zones with the same name.
+    struct ZoneStats
+    {
+        std::uint64_t count = 0;
+        std::uint64_t total_ns = 0;
+        std::uint64_t max_ns = 0;
+        AllocationTracking::Counters allocs;
+    };
+
+    using ZoneStatsMap = std::map<std::string, ZoneStats, std::less<>>;
+
+    // Adds the recorded zones of all threads to `stats`, merging the zones with the same names.
+    // The ring buffers only keep the recent zones, so to summarize a long run, call this periodically followed by `Clear()`.
+    inline void AccumulateZoneStats(ZoneStatsMap &stats)
+    {
+        impl::Registry &registry = impl::GetRegistry();
+        std::lock_guard lock(registry.mutex);
+
+        std::vector<impl::Entry> entries;
+        for (const auto &thread : registry.threads)
+        {
+            impl::ReadThreadEntries(*thread, entries);
+            for (const impl::Entry &entry : entries)
+            {
+                auto it = stats.find(std::string_view(entry.name));
+                if (it == stats.end())
+                    it = stats.try_emplace(entry.name).first;
+
+                ZoneStats &zone = it->second;
+                std::uint64_t duration = entry.end_ns - entry.begin_ns;
+                zone.count++;
+                zone.total_ns += duration;
+                zone.max_ns = std::max(zone.max_ns, duration);
+                zone.allocs.allocations += entry.allocs.allocations;
+                zone.allocs.bytes += entry.allocs.bytes;
+            }
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace RadixSort
+{
+    // Sorts `elems` by the 64-bit keys returned by `get_key(elem)`, in the increasing order.
+    // The sort is stable, the elements with equal keys keep their order.
+    // `buffer` is a temporary storage. Reuse the same one to avoid allocating on each call. Its contents are unspecified after the call.
+    // The keys are processed a byte at a time, and the bytes that are the same for all elements are skipped. `get_key` should be cheap.
+    template <typename T, typename F>
+    void Sort(std::vector<T> &elems, std::vector<T> &buffer, F &&get_key)
+    {
+        constexpr int key_bytes = sizeof(std::uint64_t);
+
+        if (elems.size() < 2)
+            return;
+
+        // Count all bytes in one pass.
+        std::array<std::array<std::size_t, 256>, key_bytes> counts{};
+        for (const T &elem : elems)
+        {
+            std::uint64_t key = get_key(elem);
+            for (int i = 0; i < key_bytes; i++)
+                counts[i][(key >> (i * 8)) & 0xff]++;
+        }
+
+        buffer.resize(elems.size());
+
+        for (int i = 0; i < key_bytes; i++)
+        {
+            std::array<std::size_t, 256> &count = counts[i];
+
+            // Skip the byte if it's the same in all keys.
+            if (count[(get_key(elems.front()) >> (i * 8)) & 0xff] == elems.size())
+                continue;
+
+            // Convert the counts to the starting positions.
+            std::size_t pos = 0;
+            for (std::size_t &it : count)
+                pos += std::exchange(it, pos);
+
+            for (T &elem : elems)
+                buffer[count[(get_key(elem) >> (i * 8)) & 0xff]++] = std::move(elem);
+
+            std::swap(elems, buffer);
+        }
+    }
+}
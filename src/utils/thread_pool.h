@@ -0,0 +1,323 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "macros/finally.h"
+#include "program/errors.h"
+
+/* A thread pool with work stealing.
+ *
+ * Each worker thread has its own task queue. A worker takes tasks from the back of its own queue,
+ * and when it runs out of them, it steals from the front of the other queues.
+ * Tasks submitted from outside of the pool are distributed between the queues in a round-robin fashion.
+ * Tasks submitted from a worker go to its own queue.
+ *
+ * Tasks are grouped using `ThreadPool::Group`. `Wait(group)` blocks until all tasks in the group finish,
+ * and the waiting thread helps executing the tasks in the meantime. If a task throws, the first exception is rethrown from `Wait()`.
+ *
+ * Example usage:
+ *     ThreadPool pool;
+ *     pool.ParallelFor(0, n, 256, [&](std::size_t begin, std::size_t end)
+ *     {
+ *         for (std::size_t i = begin; i < end; i++)
+ *             Process(i);
+ *     });
+ *
+ * In the deterministic mode (see `SetDeterministic()`), all tasks run immediately on the submitting thread, in the submission order.
+ * This is useful for debugging.
+ */
+
+class ThreadPool
+{
+  public:
+    // A set of tasks that can be waited for.
+    class Group
+    {
+        friend ThreadPool;
+
+        std::atomic<std::size_t> remaining = 0;
+
+        std::mutex exception_mutex;
+        std::exception_ptr exception;
+
+      public:
+        Group() {}
+
+        Group(const Group &) = delete;
+        Group &operator=(const Group &) = delete;
+
+        ~Group()
+        {
+            ASSERT(remaining.load() == 0, "Destroying a thread pool task group that still has running tasks.");
+        }
+
+        // Returns true if all tasks in this group have finished.
+        [[nodiscard]] bool Finished() const
+        {
+            return remaining.load(std::memory_order_acquire) == 0;
+        }
+    };
+
+  private:
+    struct Task
+    {
+        std::function<void()> func;
+        Group *group = nullptr;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    // Total amount of tasks in all queues.
+    std::atomic<std::size_t> queued_tasks = 0;
+    // The queue that will receive the next task submitted from the outside of the pool.
+    std::atomic<std::size_t> next_queue = 0;
+
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    bool stop = false;
+
+    bool deterministic = false;
+
+    // The pool and the worker index of the current thread, if it's a worker thread.
+    struct CurrentWorker
+    {
+        ThreadPool *pool = nullptr;
+        std::size_t index = 0;
+    };
+    static CurrentWorker &ThisThreadWorker()
+    {
+        thread_local CurrentWorker ret;
+        return ret;
+    }
+
+    // Runs a task, then marks it as finished.
+    static void RunTask(Task &task) noexcept
+    {
+        try
+        {
+            task.func();
+        }
+        catch (...)
+        {
+            std::lock_guard lock(task.group->exception_mutex);
+            if (!task.group->exception)
+                task.group->exception = std::current_exception();
+        }
+
+        task.group->remaining.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    // Tries to take a task from the queue of `own_index`-th worker (from the back), then from any other queue (from the front).
+    // If `own_index` is out of range, only steals from the other queues.
+    [[nodiscard]] bool TryTakeTask(std::size_t own_index, Task &task)
+    {
+        if (queued_tasks.load(std::memory_order_acquire) == 0)
+            return false;
+
+        if (own_index < workers.size())
+        {
+            Worker &worker = *workers[own_index];
+            std::lock_guard lock(worker.mutex);
+            if (!worker.tasks.empty())
+            {
+                task = std::move(worker.tasks.back());
+                worker.tasks.pop_back();
+                queued_tasks.fetch_sub(1, std::memory_order_acq_rel);
+                return true;
+            }
+        }
+
+        for (std::size_t i = 1; i <= workers.size(); i++)
+        {
+            Worker &victim = *workers[(own_index + i) % workers.size()];
+            std::lock_guard lock(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                queued_tasks.fetch_sub(1, std::memory_order_acq_rel);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void WorkerLoop(std::size_t index)
+    {
+        ThisThreadWorker() = {this, index};
+
+        Task task;
+        while (true)
+        {
+            if (TryTakeTask(index, task))
+            {
+                RunTask(task);
+                continue;
+            }
+
+            std::unique_lock lock(sleep_mutex);
+            sleep_cv.wait(lock, [&]{return stop || queued_tasks.load(std::memory_order_acquire) > 0;});
+            if (stop)
+                return;
+        }
+    }
+
+  public:
+    // Creates a pool with the specified amount of worker threads.
+    // By default, uses one thread less than the amount of hardware threads, since the waiting thread helps executing the tasks.
+    // Zero threads is allowed, then the tasks run on the thread that waits for them.
+    explicit ThreadPool(std::size_t thread_count = std::max(1u, std::thread::hardware_concurrency()) - 1)
+    {
+        workers.reserve(thread_count);
+        for (std::size_t i = 0; i < thread_count; i++)
+            workers.push_back(std::make_unique<Worker>());
+
+        FINALLY_ON_THROW( Stop(); )
+        for (std::size_t i = 0; i < thread_count; i++)
+            workers[i]->thread = std::thread(&ThreadPool::WorkerLoop, this, i);
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Stops the threads. Tasks that weren't started are discarded, so wait for your groups before destroying the pool.
+    ~ThreadPool()
+    {
+        Stop();
+    }
+
+    // Returns the amount of worker threads.
+    [[nodiscard]] std::size_t ThreadCount() const
+    {
+        return workers.size();
+    }
+
+    // In the deterministic mode, the tasks are executed immediately when they're submitted, on the submitting thread.
+    void SetDeterministic(bool value)
+    {
+        deterministic = value;
+    }
+    [[nodiscard]] bool IsDeterministic() const
+    {
+        return deterministic;
+    }
+
+    // Adds a task to the pool. Use `Wait(group)` to wait for it to finish.
+    // The group must outlive the task.
+    void Submit(Group &group, std::function<void()> func)
+    {
+        Task task{std::move(func), &group};
+        group.remaining.fetch_add(1, std::memory_order_acq_rel);
+
+        if (deterministic || workers.empty())
+        {
+            RunTask(task);
+            return;
+        }
+
+        CurrentWorker &current = ThisThreadWorker();
+        std::size_t queue_index = current.pool == this ? current.index : next_queue.fetch_add(1, std::memory_order_relaxed) % workers.size();
+
+        {
+            Worker &worker = *workers[queue_index];
+            std::lock_guard lock(worker.mutex);
+            FINALLY_ON_THROW( group.remaining.fetch_sub(1, std::memory_order_acq_rel); )
+            worker.tasks.push_back(std::move(task));
+            queued_tasks.fetch_add(1, std::memory_order_acq_rel);
+        }
+
+        {
+            // Locking the mutex here prevents a lost wakeup, if a worker checks `queued_tasks` right before we increment it.
+            std::lock_guard lock(sleep_mutex);
+        }
+        sleep_cv.notify_one();
+    }
+
+    // Waits for all tasks in the group to finish, helping to execute them (and any other tasks) in the meantime.
+    // If any of the tasks has thrown, rethrows the first exception.
+    void Wait(Group &group)
+    {
+        CurrentWorker &current = ThisThreadWorker();
+        std::size_t own_index = current.pool == this ? current.index : std::size_t(-1);
+
+        Task task;
+        while (!group.Finished())
+        {
+            if (TryTakeTask(own_index, task))
+                RunTask(task);
+            else
+                std::this_thread::yield();
+        }
+
+        if (group.exception)
+            std::rethrow_exception(std::exchange(group.exception, nullptr));
+    }
+
+    // Splits `[begin, end)` into batches of `grain_size` elements (the last one can be smaller),
+    // and calls `func(batch_begin, batch_end)` for each batch, in parallel. Blocks until all batches are processed.
+    // In the deterministic mode, the batches are processed in order on the current thread.
+    template <typename F>
+    void ParallelFor(std::size_t begin, std::size_t end, std::size_t grain_size, F &&func)
+    {
+        if (begin >= end)
+            return;
+        if (grain_size == 0)
+            grain_size = 1;
+
+        if (deterministic || workers.empty() || end - begin <= grain_size)
+        {
+            for (std::size_t i = begin; i < end; i += grain_size)
+                func(i, std::min(end, i + grain_size));
+            return;
+        }
+
+        Group group;
+        try
+        {
+            for (std::size_t i = begin; i < end; i += grain_size)
+                Submit(group, [&func, i, batch_end = std::min(end, i + grain_size)]{func(i, batch_end);});
+        }
+        catch (...)
+        {
+            // The submitted tasks reference `func`, so we must wait for them anyway.
+            try {Wait(group);} catch (...) {}
+            throw;
+        }
+        Wait(group);
+    }
+
+  private:
+    void Stop()
+    {
+        {
+            std::lock_guard lock(sleep_mutex);
+            stop = true;
+        }
+        sleep_cv.notify_all();
+
+        for (auto &worker : workers)
+        {
+            if (worker->thread.joinable())
+                worker->thread.join();
+        }
+    }
+};